@@ -0,0 +1,121 @@
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+
+#include "../src/map.hpp"
+#include "../src/text-analyzer.hpp"
+
+template <typename Function>
+double bestOf(int repeats, Function function)
+{
+  auto best = std::chrono::duration<double, std::milli>::max();
+  for (int i = 0; i < repeats; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    best = std::min<std::chrono::duration<double, std::milli>>(best, std::chrono::steady_clock::now() - start);
+  }
+  return best.count();
+}
+
+// Text with Zipf-distributed words, like natural language: a few words make up most of it
+std::string generateZipfText(size_t lines, size_t vocabulary, unsigned seed);
+
+double measure(TextAnalyzer & analyzer, const std::string & text, int repeats);
+
+// Full in-order traversal of a map with keys inserted in random order, so that neighbouring
+// nodes are scattered in memory, through iterators and through the stack-based for_each
+void compareTraversals(size_t size, int repeats);
+
+int main(int argc, char * argv[])
+{
+  auto lines = size_t{ (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 200000u };
+  auto repeats = (argc > 2) ? std::atoi(argv[2]) : 3;
+  auto text = generateZipfText(lines, 50000u, 1u);
+  std::cout << "Text: " << lines << " lines, " << text.size() << " bytes, best of " << repeats << " runs\n";
+
+  struct config_t
+  {
+    const char * name;
+    TextAnalyzer::Engine engine;
+    size_t wordIndexCapacity;
+  };
+  const config_t configs[] = {
+    { "ordered map", TextAnalyzer::ORDERED_MAP, TextAnalyzer::NO_WORD_INDEX },
+    { "ordered map + word index", TextAnalyzer::ORDERED_MAP, TextAnalyzer::UNBOUNDED_WORD_INDEX },
+    { "hash then sort", TextAnalyzer::HASH_THEN_SORT, TextAnalyzer::NO_WORD_INDEX },
+  };
+  for (const auto & config : configs) {
+    auto analyzer = TextAnalyzer{ };
+    analyzer.setEngine(config.engine);
+    analyzer.setWordIndexCapacity(config.wordIndexCapacity);
+    std::cout << config.name << ": " << measure(analyzer, text, repeats) << " ms\n";
+  }
+
+  compareTraversals((argc > 3) ? std::strtoul(argv[3], nullptr, 10) : 4000000u, repeats);
+
+  return 0;
+}
+
+std::string generateZipfText(size_t lines, size_t vocabulary, unsigned seed)
+{
+  auto engine = std::mt19937{ seed };
+  auto letter = std::uniform_int_distribution<int>{ 'a', 'z' };
+  auto length = std::uniform_int_distribution<int>{ 2, 10 };
+  auto words = std::vector<std::string>{ };
+  auto weights = std::vector<double>{ };
+  for (size_t i = 0u; i < vocabulary; ++i) {
+    auto word = std::string{ };
+    for (int chars = length(engine); chars > 0; --chars) {
+      word += static_cast<char>(letter(engine));
+    }
+    words.push_back(word);
+    weights.push_back(1.0 / static_cast<double>(i + 1u));
+  }
+  auto rank = std::discrete_distribution<size_t>{ weights.begin(), weights.end() };
+  auto count = std::uniform_int_distribution<int>{ 0, 16 };
+  auto text = std::string{ };
+  for (size_t i = 0u; i < lines; ++i) {
+    for (int n = count(engine); n > 0; --n) {
+      text += words[rank(engine)];
+      text += ' ';
+    }
+    text += '\n';
+  }
+  return text;
+}
+
+double measure(TextAnalyzer & analyzer, const std::string & text, int repeats)
+{
+  return bestOf(repeats, [&analyzer, &text] { analyzer.analyzeBuffer(text); });
+}
+
+void compareTraversals(size_t size, int repeats)
+{
+  auto keys = std::vector<long>(size);
+  for (size_t i = 0u; i < size; ++i) {
+    keys[i] = static_cast<long>(i);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937{ 2u });
+  auto map = Map<long, long>{ };
+  for (auto key : keys) {
+    map.insert(key, key);
+  }
+  std::cout << "Traversal of " << size << " elements, best of " << repeats << " runs\n";
+
+  auto sum = 0L;
+  auto iterators = bestOf(repeats, [&map, &sum] {
+    for (auto itr = map.begin(); itr != map.end(); ++itr) {
+      sum += itr.value();
+    }
+  });
+  auto visitor = bestOf(repeats, [&map, &sum] {
+    map.for_each([&sum] (long, long value) { sum += value; });
+  });
+  std::cout << "iterators: " << iterators << " ms\n";
+  std::cout << "for_each: " << visitor << " ms\n";
+  std::cout << "(checksum " << sum << ")\n";
+}
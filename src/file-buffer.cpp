@@ -0,0 +1,102 @@
+#include "file-buffer.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CROSS_REFS_POSIX_IO
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+FileBuffer::FileBuffer(const std::string & filename) :
+    mapping_{ nullptr },
+    size_{ 0u },
+    contents_{ }
+{
+#ifdef CROSS_REFS_POSIX_IO
+  auto fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::invalid_argument{ "Can't open file " + filename };
+  }
+  struct stat info{ };
+  if ((::fstat(fd, &info) == 0) && S_ISREG(info.st_mode) && (info.st_size > 0)) {
+    auto size = static_cast<std::size_t>(info.st_size);
+    auto mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      ::madvise(mapping, size, MADV_SEQUENTIAL);
+      mapping_ = static_cast<const char *>(mapping);
+      size_ = size;
+      ::close(fd);
+      return;
+    }
+  }
+  char chunk[1u << 16u];
+  for (auto count = ::read(fd, chunk, sizeof(chunk)); count != 0; count = ::read(fd, chunk, sizeof(chunk))) {
+    if (count < 0) {
+      ::close(fd);
+      throw std::invalid_argument{ "Can't read file " + filename };
+    }
+    contents_.append(chunk, static_cast<std::size_t>(count));
+  }
+  ::close(fd);
+#else
+  auto is = std::ifstream{ filename, std::ios::binary };
+  if (!is) {
+    throw std::invalid_argument{ "Can't open file " + filename };
+  }
+  contents_.assign(std::istreambuf_iterator<char>{ is }, std::istreambuf_iterator<char>{ });
+#endif
+  size_ = contents_.size();
+}
+
+FileBuffer::FileBuffer(FileBuffer && other) noexcept :
+    mapping_{ other.mapping_ },
+    size_{ other.size_ },
+    contents_{ std::move(other.contents_) }
+{
+  other.mapping_ = nullptr;
+  other.size_ = 0u;
+}
+
+FileBuffer::~FileBuffer()
+{
+  unmap();
+}
+
+FileBuffer & FileBuffer::operator=(FileBuffer && other) noexcept
+{
+  if (this == &other) {
+    return *this;
+  }
+  unmap();
+  mapping_ = other.mapping_;
+  size_ = other.size_;
+  contents_ = std::move(other.contents_);
+  other.mapping_ = nullptr;
+  other.size_ = 0u;
+  return *this;
+}
+
+std::string_view FileBuffer::data() const
+{
+  return { mapping_ ? mapping_ : contents_.data(), size_ };
+}
+
+bool FileBuffer::isMapped() const
+{
+  return mapping_ != nullptr;
+}
+
+void FileBuffer::unmap()
+{
+#ifdef CROSS_REFS_POSIX_IO
+  if (mapping_) {
+    ::munmap(const_cast<char *>(mapping_), size_);
+  }
+#endif
+  mapping_ = nullptr;
+}
@@ -0,0 +1,43 @@
+#ifndef CROSS_REFS_FILE_BUFFER
+#define CROSS_REFS_FILE_BUFFER
+
+#include <string>
+#include <cstddef>
+#include <string_view>
+
+// Whole file contents as one contiguous read-only buffer. Regular files are memory-mapped,
+// pipes, character devices and other unmappable files are read into memory instead.
+class FileBuffer
+{
+
+  public:
+
+    explicit FileBuffer(const std::string & filename);
+
+    FileBuffer(const FileBuffer & other) = delete;
+
+    FileBuffer(FileBuffer && other) noexcept;
+
+    ~FileBuffer();
+
+    FileBuffer & operator=(const FileBuffer & other) = delete;
+
+    FileBuffer & operator=(FileBuffer && other) noexcept;
+
+    std::string_view data() const;
+
+    bool isMapped() const;
+
+  private:
+
+    void unmap();
+
+    const char * mapping_;
+
+    std::size_t size_;
+
+    std::string contents_;
+
+};
+
+#endif
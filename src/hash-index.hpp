@@ -0,0 +1,192 @@
+#ifndef CROSS_REFS_HASH_INDEX
+#define CROSS_REFS_HASH_INDEX
+
+#include <limits>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Open-addressing hash table with linear probing, meant to sit in front of an ordered container
+// and map hot keys straight to their values. Both kinds of index start small and double when
+// half full. An unbounded index keeps every inserted key. A bounded index stops growing once it
+// has room for bound keys: each key is looked for in a short probe window, and a new key replaces
+// a resident whose hit counter runs out, so frequent keys stay.
+template <typename K, typename V, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K>>
+class HashIndex
+{
+
+  public:
+
+    static constexpr std::size_t UNBOUNDED = std::numeric_limits<std::size_t>::max();
+
+    explicit HashIndex(std::size_t bound = UNBOUNDED, const Hash & hash = Hash(),
+        const KeyEqual & equal = KeyEqual());
+
+    // Returns the value stored for key or nullptr, a hit makes the key harder to evict
+    V * find(const K & key);
+
+    // Stores value for key, a bounded index may drop the key if its probe window holds hotter keys
+    void insert(const K & key, const V & value);
+
+    void clear();
+
+    std::size_t size() const;
+
+    std::size_t bound() const;
+
+  private:
+
+    struct slot_t
+    {
+      K key;
+      V value;
+      std::size_t hash;
+      std::uint32_t hits;
+      bool used;
+    };
+
+    static constexpr std::size_t MIN_SLOTS = 64u;
+
+    static constexpr std::size_t PROBE_LIMIT = 8u;
+
+    std::size_t probe_limit() const;
+
+    void grow();
+
+    std::vector<slot_t> slots_;
+
+    std::size_t size_;
+
+    std::size_t bound_;
+
+    // Slot count a bounded index stops growing at, the smallest power of two holding bound keys
+    std::size_t max_slots_;
+
+    Hash hash_;
+
+    KeyEqual equal_;
+
+};
+
+template <typename K, typename V, typename Hash, typename KeyEqual>
+HashIndex<K, V, Hash, KeyEqual>::HashIndex(std::size_t bound, const Hash & hash, const KeyEqual & equal) :
+    slots_{ },
+    size_{ 0u },
+    bound_{ bound ? bound : 1u },
+    max_slots_{ MIN_SLOTS },
+    hash_{ hash },
+    equal_{ equal }
+{
+  // Doubling stops short of overflow, a bound no table could hold leaves the index unlimited in practice
+  while ((max_slots_ < bound_) && (max_slots_ <= std::numeric_limits<std::size_t>::max() / 2u)) {
+    max_slots_ *= 2u;
+  }
+  slots_.resize(MIN_SLOTS);
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual>
+V * HashIndex<K, V, Hash, KeyEqual>::find(const K & key)
+{
+  auto hash = hash_(key);
+  auto mask = slots_.size() - 1u;
+  auto limit = probe_limit();
+  for (std::size_t i = 0u, j = hash & mask; (i < limit) && slots_[j].used; ++i, j = (j + 1u) & mask) {
+    auto & slot = slots_[j];
+    if ((slot.hash == hash) && equal_(slot.key, key)) {
+      if (slot.hits != std::numeric_limits<std::uint32_t>::max()) {
+        ++slot.hits;
+      }
+      return &slot.value;
+    }
+  }
+  return nullptr;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual>
+void HashIndex<K, V, Hash, KeyEqual>::insert(const K & key, const V & value)
+{
+  if (((bound_ == UNBOUNDED) || (slots_.size() < max_slots_)) && (2u * (size_ + 1u) > slots_.size())) {
+    grow();
+  }
+  auto hash = hash_(key);
+  auto mask = slots_.size() - 1u;
+  auto limit = probe_limit();
+  auto i = std::size_t{ 0u };
+  auto j = hash & mask;
+  for (; (i < limit) && slots_[j].used; ++i, j = (j + 1u) & mask) {
+    auto & slot = slots_[j];
+    if ((slot.hash == hash) && equal_(slot.key, key)) {
+      slot.value = value;
+      return;
+    }
+  }
+  if ((i < limit) && (size_ < bound_)) {
+    slots_[j] = { key, value, hash, 1u, true };
+    ++size_;
+    return;
+  }
+  // No room left: age the residents of the window and let the key take the first one that went cold
+  j = hash & mask;
+  for (i = 0u; (i < limit) && slots_[j].used; ++i, j = (j + 1u) & mask) {
+    auto & slot = slots_[j];
+    if (--slot.hits == 0u) {
+      slot = { key, value, hash, 1u, true };
+      return;
+    }
+  }
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual>
+void HashIndex<K, V, Hash, KeyEqual>::clear()
+{
+  for (auto & slot : slots_) {
+    slot = slot_t{ };
+  }
+  size_ = 0u;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual>
+std::size_t HashIndex<K, V, Hash, KeyEqual>::size() const
+{
+  return size_;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual>
+std::size_t HashIndex<K, V, Hash, KeyEqual>::bound() const
+{
+  return bound_;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual>
+std::size_t HashIndex<K, V, Hash, KeyEqual>::probe_limit() const
+{
+  return (bound_ == UNBOUNDED) ? slots_.size() : PROBE_LIMIT;
+}
+
+// A bounded index drops the rare key that no longer fits its probe window, it is only a cache
+template <typename K, typename V, typename Hash, typename KeyEqual>
+void HashIndex<K, V, Hash, KeyEqual>::grow()
+{
+  auto old = std::vector<slot_t>(slots_.size() * 2u);
+  old.swap(slots_);
+  auto mask = slots_.size() - 1u;
+  auto limit = probe_limit();
+  for (auto & slot : old) {
+    if (slot.used) {
+      auto i = std::size_t{ 0u };
+      auto j = slot.hash & mask;
+      while ((i < limit) && slots_[j].used) {
+        ++i;
+        j = (j + 1u) & mask;
+      }
+      if (i < limit) {
+        slots_[j] = std::move(slot);
+      } else {
+        --size_;
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,589 @@
+#ifndef CROSS_REFS_INDEXED_MAP
+#define CROSS_REFS_INDEXED_MAP
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <stdexcept>
+#include <functional>
+
+#include "map.hpp"
+
+namespace indexed_map_details
+{
+  template <typename K, typename V>
+  struct node_t;
+}
+
+// Red-black tree dictionary with the same interface as Map, whose nodes live in one vector
+// and are linked by 32-bit indices. Links take half the space of pointers and the tree stays
+// valid when the vector is copied or relocated: data() and size() expose the node array, and
+// the nodes of trivially copyable keys and values can be saved with a single memcpy and
+// restored with the node array constructor.
+// Iterators refer to the map object, so they survive insertions but not a move of the map.
+template <typename K, typename V, typename Comparator = std::less<K>>
+class IndexedMap
+{
+
+  public:
+
+    class iterator;
+
+    class const_iterator;
+
+    using node_type = indexed_map_details::node_t<K, V>;
+
+    explicit IndexedMap(const Comparator & cmp = Comparator());
+
+    // Adopts count nodes taken from data() of another map, throws std::invalid_argument
+    // unless their links form a single red-black tree ordered by cmp that holds every node
+    IndexedMap(const node_type * nodes, std::size_t count, const Comparator & cmp = Comparator());
+
+    void insert(const K & key, const V & value);
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const K & key, Args && ... args);
+
+    bool contains(const K & key) const;
+
+    V & operator[](const K & key);
+
+    const V & operator[](const K & key) const;
+
+    iterator begin();
+
+    iterator end();
+
+    const_iterator begin() const;
+
+    const_iterator end() const;
+
+    std::size_t size() const;
+
+    const node_type * data() const;
+
+    // Checks ordering, parent links and red-black properties of the whole tree and that
+    // every stored node is reachable from the root
+    bool is_valid() const;
+
+  private:
+
+    struct IndexedMapImpl;
+
+    IndexedMapImpl impl_;
+
+};
+
+
+namespace indexed_map_details
+{
+
+  using index_t = std::uint32_t;
+
+  // Parent links share their word with the colour, which limits a tree to 2^31 - 1 nodes
+  const index_t NIL = 0x7FFFFFFFu;
+
+  const index_t COLOR_BIT = 0x80000000u;
+
+  template <typename K, typename V>
+  struct node_t
+  {
+    index_t left;
+    index_t right;
+    index_t parent_color;
+    K key;
+    V value;
+  };
+
+  template <typename K, typename V>
+  using nodes_t = std::vector<node_t<K, V>>;
+
+  template <typename K, typename V>
+  index_t parent(const nodes_t<K, V> & nodes, index_t n)
+  {
+    return nodes[n].parent_color & ~COLOR_BIT;
+  }
+
+  template <typename K, typename V>
+  void set_parent(nodes_t<K, V> & nodes, index_t n, index_t parent)
+  {
+    nodes[n].parent_color = parent | (nodes[n].parent_color & COLOR_BIT);
+  }
+
+  template <typename K, typename V>
+  map_details::color_t color(const nodes_t<K, V> & nodes, index_t n)
+  {
+    return ((n == NIL) || (nodes[n].parent_color & COLOR_BIT)) ? map_details::BLACK : map_details::RED;
+  }
+
+  template <typename K, typename V>
+  void set_color(nodes_t<K, V> & nodes, index_t n, map_details::color_t color)
+  {
+    nodes[n].parent_color = (nodes[n].parent_color & ~COLOR_BIT) | ((color == map_details::BLACK) ? COLOR_BIT : 0u);
+  }
+
+  template <typename K, typename V>
+  index_t next(const nodes_t<K, V> & nodes, index_t n)
+  {
+    if (nodes[n].right != NIL) {
+      n = nodes[n].right;
+      while (nodes[n].left != NIL) {
+        n = nodes[n].left;
+      }
+      return n;
+    }
+    auto p = parent(nodes, n);
+    while ((p != NIL) && (nodes[p].right == n)) {
+      n = p;
+      p = parent(nodes, n);
+    }
+    return p;
+  }
+
+  template <typename K, typename V>
+  index_t leftmost(const nodes_t<K, V> & nodes, index_t n)
+  {
+    while ((n != NIL) && (nodes[n].left != NIL)) {
+      n = nodes[n].left;
+    }
+    return n;
+  }
+
+}
+
+template <typename K, typename V, typename Comparator>
+class IndexedMap<K, V, Comparator>::iterator
+{
+
+  public:
+
+    iterator(indexed_map_details::nodes_t<K, V> * nodes, indexed_map_details::index_t index) :
+        nodes_{ nodes },
+        index_{ index }
+    { }
+
+    iterator & operator++()
+    {
+      index_ = indexed_map_details::next(*nodes_, index_);
+      return *this;
+    }
+
+    iterator operator++(int)
+    {
+      auto t = *this;
+      index_ = indexed_map_details::next(*nodes_, index_);
+      return t;
+    }
+
+    bool operator==(const iterator & rhs) const
+    {
+      return index_ == rhs.index_;
+    }
+
+    bool operator!=(const iterator & rhs) const
+    {
+      return index_ != rhs.index_;
+    }
+
+    K & key()
+    {
+      return (*nodes_)[index_].key;
+    }
+
+    V & value()
+    {
+      return (*nodes_)[index_].value;
+    }
+
+  private:
+
+    indexed_map_details::nodes_t<K, V> * nodes_;
+
+    indexed_map_details::index_t index_;
+
+};
+
+template <typename K, typename V, typename Comparator>
+class IndexedMap<K, V, Comparator>::const_iterator
+{
+
+  public:
+
+    const_iterator(const indexed_map_details::nodes_t<K, V> * nodes, indexed_map_details::index_t index) :
+        nodes_{ nodes },
+        index_{ index }
+    { }
+
+    const_iterator & operator++()
+    {
+      index_ = indexed_map_details::next(*nodes_, index_);
+      return *this;
+    }
+
+    const_iterator operator++(int)
+    {
+      auto t = *this;
+      index_ = indexed_map_details::next(*nodes_, index_);
+      return t;
+    }
+
+    bool operator==(const const_iterator & rhs) const
+    {
+      return index_ == rhs.index_;
+    }
+
+    bool operator!=(const const_iterator & rhs) const
+    {
+      return index_ != rhs.index_;
+    }
+
+    const K & key()
+    {
+      return (*nodes_)[index_].key;
+    }
+
+    const V & value()
+    {
+      return (*nodes_)[index_].value;
+    }
+
+  private:
+
+    const indexed_map_details::nodes_t<K, V> * nodes_;
+
+    indexed_map_details::index_t index_;
+
+};
+
+template <typename K, typename V, typename Comparator>
+struct IndexedMap<K, V, Comparator>::IndexedMapImpl
+{
+  indexed_map_details::nodes_t<K, V> nodes;
+  indexed_map_details::index_t root;
+  Comparator cmp;
+};
+
+template <typename K, typename V, typename Comparator>
+IndexedMap<K, V, Comparator>::IndexedMap(const Comparator & cmp) :
+    impl_{ { }, indexed_map_details::NIL, cmp }
+{ }
+
+template <typename K, typename V, typename Comparator>
+IndexedMap<K, V, Comparator>::IndexedMap(const node_type * nodes, std::size_t count, const Comparator & cmp) :
+    impl_{ { }, indexed_map_details::NIL, cmp }
+{
+  if (count >= indexed_map_details::NIL) {
+    throw std::length_error{ "Too many keys for 32-bit node indices" };
+  }
+  impl_.nodes.assign(nodes, nodes + count);
+  for (auto n = std::size_t{ 0u }; n < count; ++n) {
+    if (indexed_map_details::parent(impl_.nodes, static_cast<indexed_map_details::index_t>(n)) == indexed_map_details::NIL) {
+      impl_.root = static_cast<indexed_map_details::index_t>(n);
+      break;
+    }
+  }
+  // A second root, a cycle or a stray link leaves some node unreachable from the first root
+  if (!is_valid()) {
+    throw std::invalid_argument{ "Node array does not form a single red-black tree" };
+  }
+}
+
+template <typename K, typename V, typename Comparator>
+void IndexedMap<K, V, Comparator>::insert(const K & key, const V & value)
+{
+  auto result = try_emplace(key, value);
+  if (!result.second) {
+    result.first.value() = value;
+  }
+}
+
+namespace indexed_map_details
+{
+  struct search_result_t
+  {
+    index_t found;
+    index_t parent;
+    bool left;
+  };
+
+  template <typename K, typename V, typename Comparator>
+  search_result_t search(const nodes_t<K, V> & nodes, index_t root, const K & key, const Comparator & cmp);
+
+  template <typename K, typename V>
+  void insert_fixup(nodes_t<K, V> & nodes, index_t & root, index_t n);
+}
+
+template <typename K, typename V, typename Comparator>
+template <typename... Args>
+std::pair<typename IndexedMap<K, V, Comparator>::iterator, bool>
+IndexedMap<K, V, Comparator>::try_emplace(const K & key, Args && ... args)
+{
+  auto place = indexed_map_details::search(impl_.nodes, impl_.root, key, impl_.cmp);
+  if (place.found != indexed_map_details::NIL) {
+    return { iterator(&impl_.nodes, place.found), false };
+  }
+  if (impl_.nodes.size() >= indexed_map_details::NIL) {
+    throw std::length_error{ "Too many keys for 32-bit node indices" };
+  }
+  auto current = static_cast<indexed_map_details::index_t>(impl_.nodes.size());
+  impl_.nodes.push_back({ indexed_map_details::NIL, indexed_map_details::NIL, place.parent,
+      key, V(std::forward<Args>(args)...) });
+  if (place.parent == indexed_map_details::NIL) {
+    impl_.root = current;
+  } else if (place.left) {
+    impl_.nodes[place.parent].left = current;
+  } else {
+    impl_.nodes[place.parent].right = current;
+  }
+  indexed_map_details::insert_fixup(impl_.nodes, impl_.root, current);
+  return { iterator(&impl_.nodes, current), true };
+}
+
+template <typename K, typename V, typename Comparator>
+bool IndexedMap<K, V, Comparator>::contains(const K & key) const
+{
+  return indexed_map_details::search(impl_.nodes, impl_.root, key, impl_.cmp).found != indexed_map_details::NIL;
+}
+
+template <typename K, typename V, typename Comparator>
+V & IndexedMap<K, V, Comparator>::operator[](const K & key)
+{
+  auto node = indexed_map_details::search(impl_.nodes, impl_.root, key, impl_.cmp).found;
+  if (node != indexed_map_details::NIL) {
+    return impl_.nodes[node].value;
+  }
+  throw std::invalid_argument{ "No such key in map!" };
+}
+
+template <typename K, typename V, typename Comparator>
+const V & IndexedMap<K, V, Comparator>::operator[](const K & key) const
+{
+  auto node = indexed_map_details::search(impl_.nodes, impl_.root, key, impl_.cmp).found;
+  if (node != indexed_map_details::NIL) {
+    return impl_.nodes[node].value;
+  }
+  throw std::invalid_argument{ "No such key in map!" };
+}
+
+template <typename K, typename V, typename Comparator>
+typename IndexedMap<K, V, Comparator>::iterator IndexedMap<K, V, Comparator>::begin()
+{
+  return iterator(&impl_.nodes, indexed_map_details::leftmost(impl_.nodes, impl_.root));
+}
+
+template <typename K, typename V, typename Comparator>
+typename IndexedMap<K, V, Comparator>::iterator IndexedMap<K, V, Comparator>::end()
+{
+  return iterator(&impl_.nodes, indexed_map_details::NIL);
+}
+
+template <typename K, typename V, typename Comparator>
+typename IndexedMap<K, V, Comparator>::const_iterator IndexedMap<K, V, Comparator>::begin() const
+{
+  return const_iterator(&impl_.nodes, indexed_map_details::leftmost(impl_.nodes, impl_.root));
+}
+
+template <typename K, typename V, typename Comparator>
+typename IndexedMap<K, V, Comparator>::const_iterator IndexedMap<K, V, Comparator>::end() const
+{
+  return const_iterator(&impl_.nodes, indexed_map_details::NIL);
+}
+
+template <typename K, typename V, typename Comparator>
+std::size_t IndexedMap<K, V, Comparator>::size() const
+{
+  return impl_.nodes.size();
+}
+
+template <typename K, typename V, typename Comparator>
+const typename IndexedMap<K, V, Comparator>::node_type * IndexedMap<K, V, Comparator>::data() const
+{
+  return impl_.nodes.data();
+}
+
+namespace indexed_map_details
+{
+  template <typename K, typename V, typename Comparator>
+  bool is_valid_tree(const nodes_t<K, V> & nodes, index_t root, const Comparator & cmp);
+}
+
+template <typename K, typename V, typename Comparator>
+bool IndexedMap<K, V, Comparator>::is_valid() const
+{
+  return indexed_map_details::is_valid_tree<K, V>(impl_.nodes, impl_.root, impl_.cmp);
+}
+
+namespace indexed_map_details
+{
+
+  template <typename K, typename V, typename Comparator>
+  search_result_t search(const nodes_t<K, V> & nodes, index_t root, const K & key, const Comparator & cmp)
+  {
+    auto parent = NIL;
+    auto left = false;
+    if constexpr (map_details::uses_three_way_compare<Comparator, K, K>::value) {
+      for (auto current = root; current != NIL; current = left ? nodes[current].left : nodes[current].right) {
+        auto order = map_details::three_way_compare<Comparator>::compare(cmp, key, nodes[current].key);
+        if (order == 0) {
+          return { current, NIL, false };
+        }
+        parent = current;
+        left = order < 0;
+      }
+    } else {
+      auto candidate = NIL;
+      for (auto current = root; current != NIL; current = left ? nodes[current].left : nodes[current].right) {
+        parent = current;
+        left = !cmp(nodes[current].key, key);
+        if (left) {
+          candidate = current;
+        }
+      }
+      if ((candidate != NIL) && !cmp(key, nodes[candidate].key)) {
+        return { candidate, NIL, false };
+      }
+    }
+    return { NIL, parent, left };
+  }
+
+  template <typename K, typename V>
+  void rotate_left(nodes_t<K, V> & nodes, index_t & root, index_t n)
+  {
+    auto pivot = nodes[n].right;
+    auto p = parent(nodes, n);
+
+    nodes[n].right = nodes[pivot].left;
+    if (nodes[n].right != NIL) {
+      set_parent(nodes, nodes[n].right, n);
+    }
+    nodes[pivot].left = n;
+    set_parent(nodes, n, pivot);
+
+    if (p == NIL) {
+      root = pivot;
+    } else if (nodes[p].left == n) {
+      nodes[p].left = pivot;
+    } else {
+      nodes[p].right = pivot;
+    }
+    set_parent(nodes, pivot, p);
+  }
+
+  template <typename K, typename V>
+  void rotate_right(nodes_t<K, V> & nodes, index_t & root, index_t n)
+  {
+    auto pivot = nodes[n].left;
+    auto p = parent(nodes, n);
+
+    nodes[n].left = nodes[pivot].right;
+    if (nodes[n].left != NIL) {
+      set_parent(nodes, nodes[n].left, n);
+    }
+    nodes[pivot].right = n;
+    set_parent(nodes, n, pivot);
+
+    if (p == NIL) {
+      root = pivot;
+    } else if (nodes[p].left == n) {
+      nodes[p].left = pivot;
+    } else {
+      nodes[p].right = pivot;
+    }
+    set_parent(nodes, pivot, p);
+  }
+
+  // Same cases as map_details::insert_case_1..5, unrolled into a loop
+  template <typename K, typename V>
+  void insert_fixup(nodes_t<K, V> & nodes, index_t & root, index_t n)
+  {
+    while ((n != root) && (color(nodes, parent(nodes, n)) == map_details::RED)) {
+      auto p = parent(nodes, n);
+      auto gp = parent(nodes, p);
+      auto p_is_left = nodes[gp].left == p;
+      auto u = p_is_left ? nodes[gp].right : nodes[gp].left;
+      if (color(nodes, u) == map_details::RED) {
+        set_color(nodes, p, map_details::BLACK);
+        set_color(nodes, u, map_details::BLACK);
+        set_color(nodes, gp, map_details::RED);
+        n = gp;
+        continue;
+      }
+      if (p_is_left && (nodes[p].right == n)) {
+        rotate_left(nodes, root, p);
+        n = p;
+      } else if (!p_is_left && (nodes[p].left == n)) {
+        rotate_right(nodes, root, p);
+        n = p;
+      }
+      p = parent(nodes, n);
+      set_color(nodes, p, map_details::BLACK);
+      set_color(nodes, gp, map_details::RED);
+      if (p_is_left) {
+        rotate_right(nodes, root, gp);
+      } else {
+        rotate_left(nodes, root, gp);
+      }
+    }
+    set_color(nodes, root, map_details::BLACK);
+  }
+
+  // Walks the tree with an explicit stack, so a damaged node array can neither recurse
+  // deeply nor loop: every child must link back to its parent and each node is counted once
+  template <typename K, typename V, typename Comparator>
+  bool is_valid_tree(const nodes_t<K, V> & nodes, index_t root, const Comparator & cmp)
+  {
+    if (root == NIL) {
+      return nodes.empty();
+    }
+    if ((root >= nodes.size()) || (parent(nodes, root) != NIL) || (color(nodes, root) != map_details::BLACK)) {
+      return false;
+    }
+    struct frame_t
+    {
+      index_t n;
+      const K * lower;
+      const K * upper;
+      std::size_t black_depth;
+    };
+    auto stack = std::vector<frame_t>{ { root, nullptr, nullptr, 1u } };
+    auto black_height = std::size_t{ 0u };
+    auto visited = std::size_t{ 0u };
+    while (!stack.empty()) {
+      auto frame = stack.back();
+      stack.pop_back();
+      if (++visited > nodes.size()) {
+        return false;
+      }
+      const auto & node = nodes[frame.n];
+      if ((frame.lower && !cmp(*frame.lower, node.key)) || (frame.upper && !cmp(node.key, *frame.upper))) {
+        return false;
+      }
+      for (auto left : { true, false }) {
+        auto child = left ? node.left : node.right;
+        if (child == NIL) {
+          if (!black_height) {
+            black_height = frame.black_depth;
+          } else if (black_height != frame.black_depth) {
+            return false;
+          }
+          continue;
+        }
+        if ((child >= nodes.size()) || (parent(nodes, child) != frame.n)
+            || ((color(nodes, frame.n) == map_details::RED) && (color(nodes, child) == map_details::RED))) {
+          return false;
+        }
+        auto depth = frame.black_depth + ((color(nodes, child) == map_details::BLACK) ? 1u : 0u);
+        if (left) {
+          stack.push_back({ child, frame.lower, &node.key, depth });
+        } else {
+          stack.push_back({ child, &node.key, frame.upper, depth });
+        }
+      }
+    }
+    return visited == nodes.size();
+  }
+
+}
+
+#endif
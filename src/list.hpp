@@ -1,10 +1,22 @@
 #ifndef CROSS_REFS_LIST
 #define CROSS_REFS_LIST
 
+#include <utility>
 #include <stdexcept>
 #include <functional>
 #include <initializer_list>
 
+#include "node-pool.hpp"
+
+namespace list_details
+{
+  template <typename T>
+  struct node_t;
+
+  template <typename T>
+  using node_ptr = node_t<T> *;
+}
+
 template <typename T>
 class List
 {
@@ -15,8 +27,13 @@ class List
 
     class const_iterator;
 
+    using pool_type = NodePool<list_details::node_t<T>>;
+
     List();
 
+    // Carves the nodes from pool, which may be shared by many lists and must outlive them all
+    explicit List(pool_type & pool);
+
     List(const List & other);
 
     List(List && other) noexcept;
@@ -29,8 +46,17 @@ class List
 
     List<T> & operator=(List && other) noexcept;
 
+    // Appends value unless an equal one is already stored
     void push_back(const T & value);
 
+    void push_back(T && value);
+
+    // Constructs the value right inside a new node, which is dropped if an equal value is already stored
+    template <typename... Args>
+    void emplace_back(Args && ... args);
+
+    void append_sorted(const T & value);
+
     void peek_front();
 
     iterator begin();
@@ -45,6 +71,16 @@ class List
 
     struct ListImpl;
 
+    template <typename... Args>
+    void link_back(Args && ... args);
+
+    template <typename... Args>
+    list_details::node_ptr<T> create_node(Args && ... args);
+
+    void destroy_node(list_details::node_ptr<T> node);
+
+    void destroy_nodes();
+
     ListImpl impl;
 
 };
@@ -52,17 +88,17 @@ class List
 namespace list_details
 {
   template <typename T>
-  struct node_t;
-
-  template <typename T>
-  using node_ptr = node_t<T> *;
-
-  template <typename T>
-  using const_node_ptr = node_t<const T> *;
+  using const_node_ptr = const node_t<T> *;
 
   template <typename T>
   struct node_t
   {
+    template <typename... Args>
+    explicit node_t(Args && ... args) :
+        value(std::forward<Args>(args)...),
+        next{ nullptr }
+    { }
+
     T value;
     node_ptr<T> next;
   };
@@ -160,23 +196,27 @@ template <typename T>
 struct List<T>::ListImpl
 {
   list_details::node_ptr<T> head;
+  list_details::node_ptr<T> tail;
+  // Owned by the caller and shared between lists, without a pool every node is allocated on its own
+  pool_type * pool;
 };
 
 template <typename T>
 List<T>::List() :
-    impl{ nullptr }
+    impl{ nullptr, nullptr, nullptr }
+{ }
+
+template <typename T>
+List<T>::List(pool_type & pool) :
+    impl{ nullptr, nullptr, &pool }
 { }
 
 template <typename T>
 List<T>::List(const List & other) :
-    impl{ nullptr }
+    impl{ nullptr, nullptr, other.impl.pool }
 {
-  if (!other.impl.head) {
-    return;
-  }
-  auto tail = impl.head = new list_details::node_t<T>{ other.impl.head->value, nullptr };
-  for (auto itr = other.impl.head->next; itr; itr = itr->next) {
-    tail = tail->next = new list_details::node_t<T>{ itr->value, nullptr };
+  for (auto itr = other.begin(); itr != other.end(); ++itr) {
+    link_back(*itr);
   }
 }
 
@@ -184,33 +224,22 @@ template <typename T>
 List<T>::List(List && other) noexcept :
     impl{ other.impl }
 {
-  other.impl = { nullptr };
+  other.impl.head = other.impl.tail = nullptr;
 }
 
 template <typename T>
 List<T>::List(std::initializer_list<T> list) :
-    impl{ nullptr }
+    impl{ nullptr, nullptr, nullptr }
 {
-  auto itr = list.begin();
-  auto tail = impl.head = new list_details::node_t<T>{ *itr, nullptr };
-  for (++itr; itr != list.end(); ++itr) {
-    tail = tail->next = new list_details::node_t<T>{ *itr, nullptr };
+  for (auto itr = list.begin(); itr != list.end(); ++itr) {
+    link_back(*itr);
   }
 }
 
-namespace list_details
-{
-  template <typename T>
-  void destructList(node_ptr<T> begin);
-}
-
 template <typename T>
 List<T>::~List()
 {
-  if (!impl.head) {
-    return;
-  }
-  list_details::destructList(impl.head);
+  destroy_nodes();
 }
 
 template <typename T>
@@ -219,10 +248,9 @@ List<T> & List<T>::operator=(const List & other)
   if (this == &other) {
     return *this;
   }
-  list_details::destructList(impl.head);
-  auto tail = impl.head = new list_details::node_t<T>{ other.impl.head->value, nullptr };
-  for (auto itr = other.impl.head->next; itr; itr = itr->next) {
-    tail = tail->next = new list_details::node_t<T>{ itr->value, nullptr };
+  destroy_nodes();
+  for (auto itr = other.begin(); itr != other.end(); ++itr) {
+    link_back(*itr);
   }
   return *this;
 }
@@ -230,33 +258,102 @@ List<T> & List<T>::operator=(const List & other)
 template <typename T>
 List<T> & List<T>::operator=(List && other) noexcept
 {
-  list_details::destructList(impl.head);
+  if (this == &other) {
+    return *this;
+  }
+  destroy_nodes();
   impl = other.impl;
-  other.impl = { nullptr };
+  other.impl.head = other.impl.tail = nullptr;
   return *this;
 }
 
 template <typename T>
 void List<T>::push_back(const T & value)
 {
-  if (!impl.head) {
-    impl.head = new list_details::node_t<T>{ value, nullptr };
-    return;
+  for (auto itr = impl.head; itr; itr = itr->next) {
+    if (itr->value == value) {
+      return;
+    }
   }
-  if (impl.head->value == value) {
-    return;
+  link_back(value);
+}
+
+template <typename T>
+void List<T>::push_back(T && value)
+{
+  for (auto itr = impl.head; itr; itr = itr->next) {
+    if (itr->value == value) {
+      return;
+    }
   }
-  auto tail = impl.head;
-  while (tail->next) {
-    if (tail->value == value) {
+  link_back(std::move(value));
+}
+
+template <typename T>
+template <typename... Args>
+void List<T>::emplace_back(Args && ... args)
+{
+  auto node = create_node(std::forward<Args>(args)...);
+  for (auto itr = impl.head; itr; itr = itr->next) {
+    if (itr->value == node->value) {
+      destroy_node(node);
       return;
     }
-    tail = tail->next;
   }
-  if (tail->value == value) {
+  impl.tail = (impl.tail ? impl.tail->next : impl.head) = node;
+}
+
+template <typename T>
+void List<T>::append_sorted(const T & value)
+{
+  if (impl.tail) {
+    if (value < impl.tail->value) {
+      throw std::invalid_argument{ "Value appended out of order" };
+    }
+    if (!(impl.tail->value < value)) {
       return;
+    }
   }
-  tail->next = new list_details::node_t<T>{ value, nullptr };
+  link_back(value);
+}
+
+template <typename T>
+template <typename... Args>
+void List<T>::link_back(Args && ... args)
+{
+  auto node = create_node(std::forward<Args>(args)...);
+  impl.tail = (impl.tail ? impl.tail->next : impl.head) = node;
+}
+
+template <typename T>
+template <typename... Args>
+list_details::node_ptr<T> List<T>::create_node(Args && ... args)
+{
+  if (impl.pool) {
+    return impl.pool->create(std::forward<Args>(args)...);
+  }
+  return new list_details::node_t<T>{ std::forward<Args>(args)... };
+}
+
+template <typename T>
+void List<T>::destroy_node(list_details::node_ptr<T> node)
+{
+  if (impl.pool) {
+    impl.pool->destroy(node);
+  } else {
+    delete node;
+  }
+}
+
+// Nodes of a shared pool go back to its free list for the next list to reuse
+template <typename T>
+void List<T>::destroy_nodes()
+{
+  for (auto node = impl.head; node; node = impl.head) {
+    impl.head = node->next;
+    destroy_node(node);
+  }
+  impl.tail = nullptr;
 }
 
 template <typename T>
@@ -292,17 +389,5 @@ typename List<T>::const_iterator List<T>::end() const
   return const_iterator();
 }
 
-namespace list_details
-{
-  template <typename T>
-  void destructList(node_ptr<T> begin)
-  {
-    for (auto r = begin; begin; r = begin) {
-      begin = begin->next;
-      delete r;
-    }
-  }
-}
-
 
 #endif
@@ -47,6 +47,8 @@ int main(int, char * [])
 void analyzeText(const std::string & inFilename)
 {
   TextAnalyzer textAnalyzer{ };
+  textAnalyzer.setThreadCount(0u);
+  textAnalyzer.setWordIndexCapacity(TextAnalyzer::UNBOUNDED_WORD_INDEX);
   textAnalyzer.analyze(inFilename);
   std::cout << "Enter 1 to output analysis to terminal "
             << "or enter output file name including extension: \n";
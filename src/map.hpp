@@ -1,7 +1,29 @@
 #ifndef CROSS_REFS_MAP
 #define CROSS_REFS_MAP
 
+#include <tuple>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <stdexcept>
 #include <functional>
+#include <string_view>
+#include <type_traits>
+
+#include "node-pool.hpp"
+
+namespace map_details
+{
+  template <typename K, typename V, typename Comparator>
+  struct node_t;
+
+  template <typename K, typename V, typename Comparator>
+  struct header_t;
+}
 
 template <typename K, typename V, typename Comparator = std::less<K>>
 class Map
@@ -13,6 +35,10 @@ class Map
 
     class const_iterator;
 
+    class reverse_iterator;
+
+    class const_reverse_iterator;
+
     explicit Map(const Comparator & cmp = Comparator());
 
     Map(const Map & other) = delete;
@@ -25,14 +51,117 @@ class Map
 
     ~Map();
 
+    // Destroys every element in O(n) without recursion and keeps the node memory for later
+    // insertions; only keys and values with trivial destructors are not visited at all
+    void clear();
+
+    // Clears the map and deals its node memory out to parts empty maps with the same comparator,
+    // merging them back into one map gathers the memory again
+    std::vector<Map> divide_memory(std::size_t parts);
+
     void insert(const K & key, const V & value);
 
-    bool contains(const K & key);
+    void insert(K && key, V && value);
+
+    // Constructs the value from args right inside the new node if key is missing,
+    // an rvalue key is moved into the node and left untouched when it is already present
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const K & key, Args && ... args);
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(K && key, Args && ... args);
+
+    // Replaces the contents with a range of key-value pairs sorted by strictly increasing keys in O(n)
+    template <typename ForwardIterator>
+    void assign_sorted(ForwardIterator first, ForwardIterator last);
+
+    // Moves every node of other into this map in O(n + m), values of keys present in both maps
+    // are combined by merge_values(V & value, V && other_value) and other is left empty
+    template <typename MergeFunction>
+    void merge(Map && other, MergeFunction merge_values);
+
+    // Removes the element with an equivalent key, returns the number of removed elements
+    std::size_t erase(const K & key);
+
+    // Removes the element at pos, returns the iterator following it
+    iterator erase(iterator pos);
+
+    // Removes [first, last) in O(k + log^2 n): the tree is split around the range,
+    // the k removed nodes are destroyed and the remaining parts are joined back
+    iterator erase(iterator first, iterator last);
+
+    bool contains(const K & key) const;
+
+    iterator find(const K & key);
+
+    const_iterator find(const K & key) const;
 
     V & operator[](const K & key);
 
     const V & operator[](const K & key) const;
 
+    // Heterogeneous lookup, available when Comparator::is_transparent is defined (e.g. std::less<>),
+    // compares any key-like value with the stored keys without converting it to K
+    template <typename KeyLike, typename Cmp = Comparator, typename = typename Cmp::is_transparent>
+    bool contains(const KeyLike & key) const;
+
+    template <typename KeyLike, typename Cmp = Comparator, typename = typename Cmp::is_transparent>
+    iterator find(const KeyLike & key);
+
+    template <typename KeyLike, typename Cmp = Comparator, typename = typename Cmp::is_transparent>
+    const_iterator find(const KeyLike & key) const;
+
+    template <typename KeyLike, typename Cmp = Comparator, typename = typename Cmp::is_transparent>
+    V & operator[](const KeyLike & key);
+
+    template <typename KeyLike, typename Cmp = Comparator, typename = typename Cmp::is_transparent>
+    const V & operator[](const KeyLike & key) const;
+
+    // Ordered range queries in O(log n), the k elements of a range are then visited in O(k)
+    iterator lower_bound(const K & key);
+
+    const_iterator lower_bound(const K & key) const;
+
+    iterator upper_bound(const K & key);
+
+    const_iterator upper_bound(const K & key) const;
+
+    std::pair<iterator, iterator> equal_range(const K & key);
+
+    std::pair<const_iterator, const_iterator> equal_range(const K & key) const;
+
+    // Elements whose keys start with prefix, for string-like keys in lexicographic order
+    std::pair<iterator, iterator> prefix_range(std::string_view prefix);
+
+    std::pair<const_iterator, const_iterator> prefix_range(std::string_view prefix) const;
+
+    std::size_t size() const;
+
+    // Order statistics in O(log n) from subtree sizes kept in every node: rank() counts the keys
+    // ordered before key, select() returns the element with the given zero-based position and
+    // count_range() counts the keys in [lower, upper). Sizes are 32-bit, so insertions past
+    // 2^32 - 1 keys throw std::length_error
+    std::size_t rank(const K & key) const;
+
+    iterator select(std::size_t position);
+
+    const_iterator select(std::size_t position) const;
+
+    std::size_t count_range(const K & lower, const K & upper) const;
+
+    // Visits every element in order as visit(key, value) without climbing parent links: the path
+    // from the root is kept on a fixed stack, as a red-black tree of n nodes is at most 2 log2(n + 1) deep
+    template <typename Visitor>
+    void for_each(Visitor visit);
+
+    template <typename Visitor>
+    void for_each(Visitor visit) const;
+
+    // The first and the last elements are cached, so all of these take O(1). Iterators are one word
+    // and stay valid, moves of the map included, until their element is erased. end() points to a
+    // header owned by the map, so every end() compares equal and decrements to the current last
+    // element whatever was inserted or erased since; a map that was moved from gets a new header
+    // on its next insertion, which invalidates the end() taken while it was empty.
     iterator begin();
 
     iterator end();
@@ -41,10 +170,35 @@ class Map
 
     const_iterator end() const;
 
+    reverse_iterator rbegin();
+
+    reverse_iterator rend();
+
+    const_reverse_iterator rbegin() const;
+
+    const_reverse_iterator rend() const;
+
+    // Checks ordering, parent links, cached bounds, subtree sizes and red-black properties of the whole tree
+    bool is_valid() const;
+
   private:
 
     struct MapImpl;
 
+    template <typename Key, typename... Args>
+    std::pair<iterator, bool> emplace_key(Key && key, Args && ... args);
+
+    // Wraps a node found in the tree, null stands for end()
+    iterator make_iterator(map_details::node_t<K, V, Comparator> * node);
+
+    const_iterator make_iterator(const map_details::node_t<K, V, Comparator> * node) const;
+
+    // Gives a moved-from map a header again before nodes are added to it
+    void ensure_header();
+
+    // Points the parent link of the root to the header after the root may have changed
+    void attach_root();
+
     MapImpl impl_;
 
 };
@@ -53,29 +207,265 @@ class Map
 namespace map_details
 {
 
-  template <typename K, typename V>
+  template <typename K, typename V, typename Comparator>
   struct node_t;
 
-  template <typename K, typename V>
-  using node_ptr = node_t<K, V> *;
+  template <typename K, typename V, typename Comparator>
+  using node_ptr = node_t<K, V, Comparator> *;
 
-  template <typename K, typename V>
-  using const_node_ptr = const node_t<K, V> *;
+  template <typename K, typename V, typename Comparator>
+  using const_node_ptr = const node_t<K, V, Comparator> *;
 
   enum color_t
   {
     RED = false, BLACK = true
   };
 
-  template <typename K, typename V>
-  struct node_t
+  // Comparators that can order two keys with a single call returning <0, 0 or >0.
+  // Specialize for custom comparators to enable early-exit descent, lexicographic ones
+  // order keys bytewise and can also be answered from cached key prefixes.
+  template <typename Comparator>
+  struct three_way_compare
+  {
+    static constexpr bool enabled = false;
+    static constexpr bool lexicographic = false;
+  };
+
+  template <>
+  struct three_way_compare<std::less<std::string>>
+  {
+    static constexpr bool enabled = true;
+    static constexpr bool lexicographic = true;
+
+    static int compare(const std::less<std::string> &, std::string_view lhs, std::string_view rhs)
+    {
+      return lhs.compare(rhs);
+    }
+  };
+
+  template <>
+  struct three_way_compare<std::less<std::string_view>>
+  {
+    static constexpr bool enabled = true;
+    static constexpr bool lexicographic = true;
+
+    static int compare(const std::less<std::string_view> &, std::string_view lhs, std::string_view rhs)
+    {
+      return lhs.compare(rhs);
+    }
+  };
+
+  // Transparent std::less<> orders keys of any type, so it is only compared three-way when the
+  // stored key is a string class and the looked up key is string-like: pointer keys such as
+  // const char * are ordered by address
+  template <>
+  struct three_way_compare<std::less<>>
+  {
+    static constexpr bool enabled = true;
+    static constexpr bool lexicographic = true;
+
+    static int compare(const std::less<> &, std::string_view lhs, std::string_view rhs)
+    {
+      return lhs.compare(rhs);
+    }
+  };
+
+  // Leading bytes of string keys packed big-endian into one word, so that comparing two
+  // prefixes orders keys like std::string::compare unless their first eight bytes are equal
+  inline std::uint64_t make_key_prefix(std::string_view key)
+  {
+    auto value = std::uint64_t{ 0u };
+    for (std::size_t i = 0u; i < sizeof(value); ++i) {
+      value <<= 8u;
+      if (i < key.size()) {
+        value |= static_cast<unsigned char>(key[i]);
+      }
+    }
+    return value;
+  }
+
+  // Nodes cache the key prefix only when the comparator orders keys bytewise and the key
+  // is a string class, other maps never read it and pointer keys may be null
+  template <typename K, typename Comparator, bool = three_way_compare<Comparator>::lexicographic
+      && std::is_class<K>::value && std::is_convertible<const K &, std::string_view>::value>
+  struct key_prefix_t
+  {
+    static constexpr bool enabled = false;
+
+    explicit key_prefix_t(const K &)
+    { }
+  };
+
+  template <typename K, typename Comparator>
+  struct key_prefix_t<K, Comparator, true>
+  {
+    static constexpr bool enabled = true;
+
+    explicit key_prefix_t(const K & key) : prefix{ make_key_prefix(key) }
+    { }
+
+    std::uint64_t prefix;
+  };
+
+  // Subtree sizes are 32-bit like the node indices of IndexedMap, so a map holds at most this many keys
+  constexpr std::size_t MAX_SIZE = std::numeric_limits<std::uint32_t>::max();
+
+  // Links come first and the colour lives in the lowest bit of the parent address,
+  // so descending through string keys usually reads only the links and the key prefix.
+  // Every node also counts the nodes of its subtree for order statistics.
+  template <typename K, typename V, typename Comparator>
+  struct node_t : key_prefix_t<K, Comparator>
   {
+    template <typename Key, typename Value>
+    node_t(Key && key, Value && value, color_t color, map_details::node_ptr<K, V, Comparator> parent,
+        map_details::node_ptr<K, V, Comparator> left, map_details::node_ptr<K, V, Comparator> right) :
+        key_prefix_t<K, Comparator>{ key },
+        left{ left },
+        right{ right },
+        parent_color{ reinterpret_cast<std::uintptr_t>(parent) | color },
+        size{ 1u },
+        key(std::forward<Key>(key)),
+        value(std::forward<Value>(value))
+    { }
+
+    template <typename Key, typename... Args>
+    node_t(std::piecewise_construct_t, Key && key, std::tuple<Args...> args, color_t color,
+        map_details::node_ptr<K, V, Comparator> parent, map_details::node_ptr<K, V, Comparator> left, map_details::node_ptr<K, V, Comparator> right) :
+        key_prefix_t<K, Comparator>{ key },
+        left{ left },
+        right{ right },
+        parent_color{ reinterpret_cast<std::uintptr_t>(parent) | color },
+        size{ 1u },
+        key(std::forward<Key>(key)),
+        value(std::make_from_tuple<V>(std::move(args)))
+    { }
+
+    // The root keeps the map header in place of its parent, flagged by the second lowest bit,
+    // and reports no parent; set_parent() clears the flag
+    map_details::node_ptr<K, V, Comparator> parent() const
+    {
+      return (parent_color & HEADER_BIT) ? nullptr
+          : reinterpret_cast<map_details::node_ptr<K, V, Comparator>>(parent_color & ~std::uintptr_t{ 1u });
+    }
+
+    void set_parent(map_details::node_ptr<K, V, Comparator> parent)
+    {
+      parent_color = reinterpret_cast<std::uintptr_t>(parent) | (parent_color & 1u);
+    }
+
+    header_t<K, V, Comparator> * header() const
+    {
+      return (parent_color & HEADER_BIT)
+          ? reinterpret_cast<header_t<K, V, Comparator> *>(parent_color & ~(HEADER_BIT | 1u)) : nullptr;
+    }
+
+    void set_header(header_t<K, V, Comparator> * header)
+    {
+      parent_color = reinterpret_cast<std::uintptr_t>(header) | HEADER_BIT | (parent_color & 1u);
+    }
+
+    static constexpr std::uintptr_t HEADER_BIT = 2u;
+
+    color_t color() const
+    {
+      return static_cast<color_t>(parent_color & 1u);
+    }
+
+    void set_color(color_t color)
+    {
+      parent_color = (parent_color & ~std::uintptr_t{ 1u }) | color;
+    }
+
+    map_details::node_ptr<K, V, Comparator> left;
+    map_details::node_ptr<K, V, Comparator> right;
+    std::uintptr_t parent_color;
+    std::uint32_t size;
     K key;
     V value;
-    color_t color;
-    map_details::node_ptr<K, V> parent;
-    map_details::node_ptr<K, V> left;
-    map_details::node_ptr<K, V> right;
+  };
+
+  // Owned by the map on the heap, so its address survives moves of the map and serves as end()
+  template <typename K, typename V, typename Comparator>
+  struct header_t
+  {
+    map_details::node_ptr<K, V, Comparator> leftmost;
+    map_details::node_ptr<K, V, Comparator> rightmost;
+  };
+
+  template <typename NodePtr>
+  auto header_of(NodePtr node)
+  {
+    while (node->parent()) {
+      node = node->parent();
+    }
+    return node->header();
+  }
+
+  template <typename K, typename V, typename Comparator>
+  std::size_t subtree_size(map_details::const_node_ptr<K, V, Comparator> node)
+  {
+    return node ? node->size : 0u;
+  }
+
+  template <typename K, typename V, typename Comparator>
+  void update_size(map_details::node_ptr<K, V, Comparator> node)
+  {
+    node->size = static_cast<std::uint32_t>(
+        1u + subtree_size<K, V, Comparator>(node->left) + subtree_size<K, V, Comparator>(node->right));
+  }
+
+  template <typename Comparator, typename K, typename KeyLike>
+  struct uses_three_way_compare
+  {
+    static constexpr bool value = three_way_compare<Comparator>::enabled;
+  };
+
+  template <typename K, typename KeyLike>
+  struct uses_three_way_compare<std::less<>, K, KeyLike>
+  {
+    static constexpr bool value = std::is_class<K>::value && std::is_convertible<const K &, std::string_view>::value
+        && std::is_convertible<const KeyLike &, std::string_view>::value;
+  };
+
+  // In-order neighbours of a node, null past either end of the tree
+  template <typename NodePtr>
+  NodePtr next_node(NodePtr node)
+  {
+    if (node->right) {
+      node = node->right;
+      while (node->left) {
+        node = node->left;
+      }
+      return node;
+    }
+    while (node->parent() && (node->parent()->right == node)) {
+      node = node->parent();
+    }
+    return node->parent();
+  }
+
+  template <typename NodePtr>
+  NodePtr prev_node(NodePtr node)
+  {
+    if (node->left) {
+      node = node->left;
+      while (node->right) {
+        node = node->right;
+      }
+      return node;
+    }
+    while (node->parent() && (node->parent()->left == node)) {
+      node = node->parent();
+    }
+    return node->parent();
+  }
+
+  template <typename K, typename V, typename Comparator>
+  struct search_result_t
+  {
+    map_details::node_ptr<K, V, Comparator> found;
+    map_details::node_ptr<K, V, Comparator> parent;
+    bool left;
   };
 
 }
@@ -86,7 +476,7 @@ class Map<K, V, Comparator>::iterator
 
   public:
 
-    explicit iterator(map_details::node_ptr<K, V> node) : node_{ node }
+    explicit iterator(map_details::node_ptr<K, V, Comparator> node) : position_{ reinterpret_cast<std::uintptr_t>(node) }
     { }
 
     iterator & operator++()
@@ -102,46 +492,76 @@ class Map<K, V, Comparator>::iterator
       return t;
     }
 
+    // Decrementing end() gives the last element
+    iterator & operator--()
+    {
+      move_prev();
+      return *this;
+    }
+
+    iterator operator--(int)
+    {
+      auto t = *this;
+      move_prev();
+      return t;
+    }
+
     bool operator==(const iterator & rhs) const
     {
-      return node_ == rhs.node_;
+      return position_ == rhs.position_;
     }
 
     bool operator!=(const iterator & rhs) const
     {
-      return node_ != rhs.node_;
+      return !(*this == rhs);
     }
 
-    K & key()
+    K & key() const
     {
-      return node_->key;
+      return node()->key;
     }
 
-    V & value()
+    V & value() const
     {
-      return node_->value;
+      return node()->value;
     }
 
   private:
 
+    friend class Map;
+
+    // The position past the last node is the map header with the lowest bit set,
+    // the header keeps the current last node for decrementing end()
+    static iterator past(const map_details::header_t<K, V, Comparator> * header)
+    {
+      auto itr = iterator(nullptr);
+      itr.position_ = reinterpret_cast<std::uintptr_t>(header) | 1u;
+      return itr;
+    }
+
+    map_details::node_ptr<K, V, Comparator> node() const
+    {
+      return (position_ & 1u) ? nullptr : reinterpret_cast<map_details::node_ptr<K, V, Comparator>>(position_);
+    }
+
     void move_next()
     {
-      if (node_->right) {
-        node_ = node_->right;
-        while (node_->left) {
-          node_ = node_->left;
-        }
-      } else if (node_->parent && (node_->parent->left == node_)) {
-        node_ = node_->parent;
-      } else {
-        while (node_->parent && (node_->parent->right == node_)) {
-          node_ = node_->parent;
-        }
-        node_ = node_->parent;
+      auto next = map_details::next_node(node());
+      position_ = next ? reinterpret_cast<std::uintptr_t>(next)
+          : (reinterpret_cast<std::uintptr_t>(map_details::header_of(node())) | 1u);
+    }
+
+    void move_prev()
+    {
+      if (position_ & 1u) {
+        auto header = reinterpret_cast<const map_details::header_t<K, V, Comparator> *>(position_ & ~std::uintptr_t{ 1u });
+        position_ = reinterpret_cast<std::uintptr_t>(header->rightmost);
+      } else if (position_) {
+        position_ = reinterpret_cast<std::uintptr_t>(map_details::prev_node(node()));
       }
     }
 
-    map_details::node_ptr<K, V> node_;
+    std::uintptr_t position_;
 
 };
 
@@ -151,7 +571,7 @@ class Map<K, V, Comparator>::const_iterator
 
   public:
 
-    explicit const_iterator(map_details::const_node_ptr<K, V> node) : node_{ node }
+    explicit const_iterator(map_details::const_node_ptr<K, V, Comparator> node) : position_{ reinterpret_cast<std::uintptr_t>(node) }
     { }
 
     const_iterator & operator++()
@@ -167,282 +587,1413 @@ class Map<K, V, Comparator>::const_iterator
       return t;
     }
 
+    // Decrementing end() gives the last element
+    const_iterator & operator--()
+    {
+      move_prev();
+      return *this;
+    }
+
+    const_iterator operator--(int)
+    {
+      auto t = *this;
+      move_prev();
+      return t;
+    }
+
     bool operator==(const const_iterator & rhs) const
     {
-      return node_ == rhs.node_;
+      return position_ == rhs.position_;
     }
 
     bool operator!=(const const_iterator & rhs) const
     {
-      return node_ != rhs.node_;
+      return !(*this == rhs);
     }
 
-    const K & key()
+    const K & key() const
     {
-      return node_->key;
+      return node()->key;
     }
 
-    const V & value()
+    const V & value() const
     {
-      return node_->value;
+      return node()->value;
     }
 
   private:
 
+    friend class Map;
+
+    // The position past the last node is the map header with the lowest bit set,
+    // the header keeps the current last node for decrementing end()
+    static const_iterator past(const map_details::header_t<K, V, Comparator> * header)
+    {
+      auto itr = const_iterator(nullptr);
+      itr.position_ = reinterpret_cast<std::uintptr_t>(header) | 1u;
+      return itr;
+    }
+
+    map_details::const_node_ptr<K, V, Comparator> node() const
+    {
+      return (position_ & 1u) ? nullptr : reinterpret_cast<map_details::const_node_ptr<K, V, Comparator>>(position_);
+    }
+
     void move_next()
     {
-      if (node_->right) {
-        node_ = node_->right;
-        while (node_->left) {
-          node_ = node_->left;
-        }
-      } else if (node_->parent && (node_->parent->left == node_)) {
-        node_ = node_->parent;
-      } else {
-        while (node_->parent && (node_->parent->right == node_)) {
-          node_ = node_->parent;
-        }
-        node_ = node_->parent;
+      auto next = map_details::next_node(node());
+      position_ = next ? reinterpret_cast<std::uintptr_t>(next)
+          : (reinterpret_cast<std::uintptr_t>(map_details::header_of(node())) | 1u);
+    }
+
+    void move_prev()
+    {
+      if (position_ & 1u) {
+        auto header = reinterpret_cast<const map_details::header_t<K, V, Comparator> *>(position_ & ~std::uintptr_t{ 1u });
+        position_ = reinterpret_cast<std::uintptr_t>(header->rightmost);
+      } else if (position_) {
+        position_ = reinterpret_cast<std::uintptr_t>(map_details::prev_node(node()));
       }
     }
 
-    map_details::const_node_ptr<K, V> node_;
+    std::uintptr_t position_;
 
 };
 
+// Walks the map from the last element to the first, rend() is the null position before the first
 template <typename K, typename V, typename Comparator>
-struct Map<K, V, Comparator>::MapImpl
+class Map<K, V, Comparator>::reverse_iterator
 {
-  map_details::node_ptr<K, V> root;
-  Comparator cmp;
-};
 
+  public:
 
-template <typename K, typename V, typename Comparator>
-Map<K, V, Comparator>::Map(const Comparator & cmp) : impl_{ nullptr, cmp }
-{ }
+    explicit reverse_iterator(iterator current) : current_{ current }
+    { }
 
-template <typename K, typename V, typename Comparator>
-Map<K, V, Comparator>::Map(Map && other) noexcept : impl_{ other.impl_ }
-{
-  other.impl_.root = nullptr;
-}
+    reverse_iterator & operator++()
+    {
+      --current_;
+      return *this;
+    }
 
-template <typename K, typename V, typename Comparator>
-Map<K, V, Comparator> & Map<K, V, Comparator>::operator=(Map && other) noexcept
-{
-  impl_ = other.impl_;
-  other.impl_.root = nullptr;
-  return *this;
-}
+    reverse_iterator operator++(int)
+    {
+      auto t = *this;
+      --current_;
+      return t;
+    }
 
-namespace map_details
-{
-  template <typename K, typename V>
-  void recursive_delete(map_details::node_ptr<K, V> node);
-}
+    bool operator==(const reverse_iterator & rhs) const
+    {
+      return current_ == rhs.current_;
+    }
 
-template <typename K, typename V, typename Comparator>
-Map<K, V, Comparator>::~Map()
-{
-  if (impl_.root) {
-    map_details::recursive_delete(impl_.root);
-  }
-}
+    bool operator!=(const reverse_iterator & rhs) const
+    {
+      return current_ != rhs.current_;
+    }
 
-namespace map_details
-{
-  template <typename K, typename V>
-  void insert_node(map_details::node_ptr<K, V> node);
-}
+    K & key() const
+    {
+      return current_.key();
+    }
+
+    V & value() const
+    {
+      return current_.value();
+    }
+
+  private:
+
+    iterator current_;
+
+};
 
+// Walks the map from the last element to the first, rend() is the null position before the first
 template <typename K, typename V, typename Comparator>
-void Map<K, V, Comparator>::insert(const K & key, const V & value)
+class Map<K, V, Comparator>::const_reverse_iterator
 {
-  auto current = impl_.root;
-  auto prev = map_details::node_ptr<K, V>{ nullptr };
-  while (current && (current->key != key)) {
-    prev = current;
-    current = impl_.cmp(current->key, key) ? current->right : current->left;
-  }
-  if (current) {
-    current->value = value;
-    return;
-  }
-  current = new map_details::node_t<K, V>{ key, value, map_details::RED, prev, nullptr, nullptr };
-  if (!impl_.root) {
+
+  public:
+
+    explicit const_reverse_iterator(const_iterator current) : current_{ current }
+    { }
+
+    const_reverse_iterator & operator++()
+    {
+      --current_;
+      return *this;
+    }
+
+    const_reverse_iterator operator++(int)
+    {
+      auto t = *this;
+      --current_;
+      return t;
+    }
+
+    bool operator==(const const_reverse_iterator & rhs) const
+    {
+      return current_ == rhs.current_;
+    }
+
+    bool operator!=(const const_reverse_iterator & rhs) const
+    {
+      return current_ != rhs.current_;
+    }
+
+    const K & key() const
+    {
+      return current_.key();
+    }
+
+    const V & value() const
+    {
+      return current_.value();
+    }
+
+  private:
+
+    const_iterator current_;
+
+};
+
+template <typename K, typename V, typename Comparator>
+struct Map<K, V, Comparator>::MapImpl
+{
+  map_details::node_ptr<K, V, Comparator> root;
+  std::unique_ptr<map_details::header_t<K, V, Comparator>> header;
+  Comparator cmp;
+  NodePool<map_details::node_t<K, V, Comparator>> pool;
+};
+
+
+template <typename K, typename V, typename Comparator>
+Map<K, V, Comparator>::Map(const Comparator & cmp) :
+    impl_{ nullptr, std::make_unique<map_details::header_t<K, V, Comparator>>(), cmp, { } }
+{ }
+
+template <typename K, typename V, typename Comparator>
+Map<K, V, Comparator>::Map(Map && other) noexcept : impl_{ std::move(other.impl_) }
+{
+  other.impl_.root = nullptr;
+}
+
+namespace map_details
+{
+  template <typename K, typename V, typename Comparator, typename Dispose>
+  void dispose_tree(map_details::node_ptr<K, V, Comparator> root, Dispose dispose);
+
+  template <typename K, typename V, typename Comparator>
+  void destroy_tree(map_details::node_ptr<K, V, Comparator> root);
+}
+
+template <typename K, typename V, typename Comparator>
+Map<K, V, Comparator> & Map<K, V, Comparator>::operator=(Map && other) noexcept
+{
+  if (this == &other) {
+    return *this;
+  }
+  map_details::destroy_tree(impl_.root);
+  impl_ = std::move(other.impl_);
+  other.impl_.root = nullptr;
+  return *this;
+}
+
+template <typename K, typename V, typename Comparator>
+Map<K, V, Comparator>::~Map()
+{
+  map_details::destroy_tree(impl_.root);
+}
+
+template <typename K, typename V, typename Comparator>
+void Map<K, V, Comparator>::clear()
+{
+  map_details::destroy_tree(impl_.root);
+  impl_.pool.reset();
+  impl_.root = nullptr;
+  if (impl_.header) {
+    impl_.header->leftmost = nullptr;
+    impl_.header->rightmost = nullptr;
+  }
+}
+
+namespace map_details
+{
+  template <typename K, typename V, typename Comparator>
+  void insert_node(map_details::node_ptr<K, V, Comparator> node);
+}
+
+template <typename K, typename V, typename Comparator>
+void Map<K, V, Comparator>::insert(const K & key, const V & value)
+{
+  auto result = try_emplace(key, value);
+  if (!result.second) {
+    result.first.value() = value;
+  }
+}
+
+template <typename K, typename V, typename Comparator>
+void Map<K, V, Comparator>::insert(K && key, V && value)
+{
+  auto result = try_emplace(std::move(key), std::move(value));
+  if (!result.second) {
+    result.first.value() = std::move(value);
+  }
+}
+
+namespace map_details
+{
+  template <typename K, typename V, typename Comparator, typename KeyLike>
+  map_details::search_result_t<K, V, Comparator>
+  search(const KeyLike & key, map_details::node_ptr<K, V, Comparator> root, const Comparator & cmp);
+}
+
+template <typename K, typename V, typename Comparator>
+template <typename... Args>
+std::pair<typename Map<K, V, Comparator>::iterator, bool>
+Map<K, V, Comparator>::try_emplace(const K & key, Args && ... args)
+{
+  return emplace_key(key, std::forward<Args>(args)...);
+}
+
+template <typename K, typename V, typename Comparator>
+template <typename... Args>
+std::pair<typename Map<K, V, Comparator>::iterator, bool>
+Map<K, V, Comparator>::try_emplace(K && key, Args && ... args)
+{
+  return emplace_key(std::move(key), std::forward<Args>(args)...);
+}
+
+template <typename K, typename V, typename Comparator>
+std::vector<Map<K, V, Comparator>> Map<K, V, Comparator>::divide_memory(std::size_t parts)
+{
+  clear();
+  auto pools = impl_.pool.divide(parts);
+  auto maps = std::vector<Map>{ };
+  maps.reserve(parts);
+  for (auto & pool : pools) {
+    maps.emplace_back(impl_.cmp);
+    maps.back().impl_.pool = std::move(pool);
+  }
+  return maps;
+}
+
+template <typename K, typename V, typename Comparator>
+template <typename Key, typename... Args>
+std::pair<typename Map<K, V, Comparator>::iterator, bool>
+Map<K, V, Comparator>::emplace_key(Key && key, Args && ... args)
+{
+  auto place = map_details::search(key, impl_.root, impl_.cmp);
+  if (place.found) {
+    return { iterator(place.found), false };
+  }
+  if (map_details::subtree_size<K, V, Comparator>(impl_.root) == map_details::MAX_SIZE) {
+    throw std::length_error{ "Too many keys for 32-bit subtree sizes" };
+  }
+  ensure_header();
+  auto current = impl_.pool.create(std::piecewise_construct, std::forward<Key>(key),
+      std::forward_as_tuple(std::forward<Args>(args)...), map_details::RED, place.parent, nullptr, nullptr);
+  if (!place.parent) {
     impl_.root = current;
-  } else if (impl_.cmp(prev->key, key)) {
-    prev->right = current;
+  } else if (place.left) {
+    place.parent->left = current;
   } else {
-    prev->left = current;
+    place.parent->right = current;
+  }
+  for (auto ancestor = place.parent; ancestor; ancestor = ancestor->parent()) {
+    ++ancestor->size;
+  }
+  if (!place.parent || (place.left && (place.parent == impl_.header->leftmost))) {
+    impl_.header->leftmost = current;
+  }
+  if (!place.parent || (!place.left && (place.parent == impl_.header->rightmost))) {
+    impl_.header->rightmost = current;
   }
   map_details::insert_node(current);
-  while (impl_.root->parent) {
-    impl_.root = impl_.root->parent;
+  while (impl_.root->parent()) {
+    impl_.root = impl_.root->parent();
+  }
+  attach_root();
+  return { iterator(current), true };
+}
+
+namespace map_details
+{
+  template <typename K, typename V, typename Comparator>
+  map_details::node_ptr<K, V, Comparator> link_balanced(map_details::node_ptr<K, V, Comparator> * nodes, std::size_t count);
+}
+
+template <typename K, typename V, typename Comparator>
+template <typename ForwardIterator>
+void Map<K, V, Comparator>::assign_sorted(ForwardIterator first, ForwardIterator last)
+{
+  auto count = std::size_t{ 0u };
+  for (auto prev = first, itr = first; itr != last; prev = itr, ++count) {
+    if ((++itr != last) && !impl_.cmp((*prev).first, (*itr).first)) {
+      throw std::invalid_argument{ "Keys must be sorted and unique" };
+    }
+  }
+  if (count > map_details::MAX_SIZE) {
+    throw std::length_error{ "Too many keys for 32-bit subtree sizes" };
+  }
+  ensure_header();
+  auto nodes = std::vector<map_details::node_ptr<K, V, Comparator>>{ };
+  try {
+    for (auto itr = first; itr != last; ++itr) {
+      nodes.push_back(impl_.pool.create((*itr).first, (*itr).second, map_details::BLACK, nullptr, nullptr, nullptr));
+    }
+  } catch (...) {
+    for (auto node : nodes) {
+      impl_.pool.destroy(node);
+    }
+    throw;
+  }
+  // The old nodes go back to the free list, so repeated assignments reuse the same slots
+  map_details::dispose_tree(impl_.root, [this] (map_details::node_ptr<K, V, Comparator> node) { impl_.pool.destroy(node); });
+  impl_.root = map_details::link_balanced(nodes.data(), nodes.size());
+  impl_.header->leftmost = nodes.empty() ? nullptr : nodes.front();
+  impl_.header->rightmost = nodes.empty() ? nullptr : nodes.back();
+  attach_root();
+}
+
+namespace map_details
+{
+  template <typename K, typename V, typename Comparator>
+  void collect_in_order(map_details::node_ptr<K, V, Comparator> root, std::vector<map_details::node_ptr<K, V, Comparator>> & nodes);
+}
+
+template <typename K, typename V, typename Comparator>
+template <typename MergeFunction>
+void Map<K, V, Comparator>::merge(Map && other, MergeFunction merge_values)
+{
+  if (this == &other) {
+    return;
+  }
+  if (!other.impl_.root) {
+    impl_.pool.splice(std::move(other.impl_.pool));
+    return;
+  }
+  if (size() + other.size() > map_details::MAX_SIZE) {
+    throw std::length_error{ "Too many keys for 32-bit subtree sizes" };
+  }
+  ensure_header();
+  auto mine = std::vector<map_details::node_ptr<K, V, Comparator>>{ };
+  auto theirs = std::vector<map_details::node_ptr<K, V, Comparator>>{ };
+  map_details::collect_in_order(impl_.root, mine);
+  map_details::collect_in_order(other.impl_.root, theirs);
+  auto nodes = std::vector<map_details::node_ptr<K, V, Comparator>>{ };
+  nodes.reserve(mine.size() + theirs.size());
+  // Both trees stay linked until every value is merged, so a throwing merge_values leaves
+  // them whole; the duplicates of other are destroyed only once the result is relinked
+  auto duplicates = std::vector<map_details::node_ptr<K, V, Comparator>>{ };
+  auto left = mine.begin();
+  auto right = theirs.begin();
+  while ((left != mine.end()) && (right != theirs.end())) {
+    if (impl_.cmp((*left)->key, (*right)->key)) {
+      nodes.push_back(*left++);
+    } else if (impl_.cmp((*right)->key, (*left)->key)) {
+      nodes.push_back(*right++);
+    } else {
+      merge_values((*left)->value, std::move((*right)->value));
+      duplicates.push_back(*right++);
+      nodes.push_back(*left++);
+    }
+  }
+  nodes.insert(nodes.end(), left, mine.end());
+  nodes.insert(nodes.end(), right, theirs.end());
+  impl_.pool.splice(std::move(other.impl_.pool));
+  other.impl_.root = nullptr;
+  other.impl_.header->leftmost = nullptr;
+  other.impl_.header->rightmost = nullptr;
+  impl_.root = map_details::link_balanced(nodes.data(), nodes.size());
+  impl_.header->leftmost = nodes.empty() ? nullptr : nodes.front();
+  impl_.header->rightmost = nodes.empty() ? nullptr : nodes.back();
+  attach_root();
+  for (auto node : duplicates) {
+    impl_.pool.destroy(node);
+  }
+}
+
+namespace map_details
+{
+  template <typename K, typename V, typename Comparator>
+  void erase_node(map_details::node_ptr<K, V, Comparator> & root, map_details::node_ptr<K, V, Comparator> z);
+
+  template <typename K, typename V, typename Comparator>
+  std::pair<map_details::node_ptr<K, V, Comparator>, map_details::node_ptr<K, V, Comparator>>
+  split(map_details::node_ptr<K, V, Comparator> root, const K & key, const Comparator & cmp);
+
+  template <typename K, typename V, typename Comparator>
+  map_details::node_ptr<K, V, Comparator> join(map_details::node_ptr<K, V, Comparator> left, map_details::node_ptr<K, V, Comparator> right);
+}
+
+template <typename K, typename V, typename Comparator>
+std::size_t Map<K, V, Comparator>::erase(const K & key)
+{
+  auto node = map_details::search(key, impl_.root, impl_.cmp).found;
+  if (!node) {
+    return 0u;
+  }
+  erase(iterator(node));
+  return 1u;
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::iterator Map<K, V, Comparator>::erase(iterator pos)
+{
+  auto node = pos.node();
+  auto next = map_details::next_node(node);
+  if (node == impl_.header->leftmost) {
+    impl_.header->leftmost = next;
+  }
+  if (node == impl_.header->rightmost) {
+    impl_.header->rightmost = map_details::prev_node(node);
+  }
+  map_details::erase_node(impl_.root, node);
+  impl_.pool.destroy(node);
+  attach_root();
+  return make_iterator(next);
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::iterator Map<K, V, Comparator>::erase(iterator first, iterator last)
+{
+  if (first == last) {
+    return last;
+  }
+  if (first.node() == impl_.header->leftmost) {
+    impl_.header->leftmost = last.node();
+  }
+  if (!last.node()) {
+    impl_.header->rightmost = map_details::prev_node(first.node());
+  }
+  auto parts = map_details::split(impl_.root, first.node()->key, impl_.cmp);
+  auto removed = parts.second;
+  auto rest = map_details::node_ptr<K, V, Comparator>{ nullptr };
+  if (last.node()) {
+    auto tail = map_details::split(parts.second, last.node()->key, impl_.cmp);
+    removed = tail.first;
+    rest = tail.second;
+  }
+  impl_.root = map_details::join(parts.first, rest);
+  auto nodes = std::vector<map_details::node_ptr<K, V, Comparator>>{ };
+  map_details::collect_in_order(removed, nodes);
+  for (auto node : nodes) {
+    impl_.pool.destroy(node);
+  }
+  attach_root();
+  return make_iterator(last.node());
+}
+
+namespace map_details
+{
+  template <typename K, typename V, typename Comparator, typename KeyLike>
+  map_details::node_ptr<K, V, Comparator>
+  find(const KeyLike & key, map_details::node_ptr<K, V, Comparator> root, const Comparator & cmp);
+}
+
+template <typename K, typename V, typename Comparator>
+bool Map<K, V, Comparator>::contains(const K & key) const
+{
+  return map_details::find(key, impl_.root, impl_.cmp);
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::iterator Map<K, V, Comparator>::find(const K & key)
+{
+  return make_iterator(map_details::find(key, impl_.root, impl_.cmp));
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::const_iterator Map<K, V, Comparator>::find(const K & key) const
+{
+  return make_iterator(map_details::find(key, impl_.root, impl_.cmp));
+}
+
+template <typename K, typename V, typename Comparator>
+V & Map<K, V, Comparator>::operator[](const K & key)
+{
+  auto node = map_details::find(key, impl_.root, impl_.cmp);
+  if (node) {
+    return node->value;
+  }
+  throw std::invalid_argument{ "No such key in map!" };
+}
+
+template <typename K, typename V, typename Comparator>
+const V & Map<K, V, Comparator>::operator[](const K & key) const
+{
+  auto node = map_details::find(key, impl_.root, impl_.cmp);
+  if (node) {
+    return node->value;
+  }
+  throw std::invalid_argument{ "No such key in map!" };
+}
+
+template <typename K, typename V, typename Comparator>
+template <typename KeyLike, typename Cmp, typename>
+bool Map<K, V, Comparator>::contains(const KeyLike & key) const
+{
+  return map_details::find(key, impl_.root, impl_.cmp);
+}
+
+template <typename K, typename V, typename Comparator>
+template <typename KeyLike, typename Cmp, typename>
+typename Map<K, V, Comparator>::iterator Map<K, V, Comparator>::find(const KeyLike & key)
+{
+  return make_iterator(map_details::find(key, impl_.root, impl_.cmp));
+}
+
+template <typename K, typename V, typename Comparator>
+template <typename KeyLike, typename Cmp, typename>
+typename Map<K, V, Comparator>::const_iterator Map<K, V, Comparator>::find(const KeyLike & key) const
+{
+  return make_iterator(map_details::find(key, impl_.root, impl_.cmp));
+}
+
+template <typename K, typename V, typename Comparator>
+template <typename KeyLike, typename Cmp, typename>
+V & Map<K, V, Comparator>::operator[](const KeyLike & key)
+{
+  auto node = map_details::find(key, impl_.root, impl_.cmp);
+  if (node) {
+    return node->value;
+  }
+  throw std::invalid_argument{ "No such key in map!" };
+}
+
+template <typename K, typename V, typename Comparator>
+template <typename KeyLike, typename Cmp, typename>
+const V & Map<K, V, Comparator>::operator[](const KeyLike & key) const
+{
+  auto node = map_details::find(key, impl_.root, impl_.cmp);
+  if (node) {
+    return node->value;
+  }
+  throw std::invalid_argument{ "No such key in map!" };
+}
+
+namespace map_details
+{
+  template <typename K, typename V, typename Comparator, typename Predicate>
+  map_details::node_ptr<K, V, Comparator> partition_point(map_details::node_ptr<K, V, Comparator> root, Predicate before);
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::iterator Map<K, V, Comparator>::lower_bound(const K & key)
+{
+  return make_iterator(map_details::partition_point(impl_.root, [this, &key] (const K & current) {
+    return impl_.cmp(current, key);
+  }));
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::const_iterator Map<K, V, Comparator>::lower_bound(const K & key) const
+{
+  return make_iterator(map_details::partition_point(impl_.root, [this, &key] (const K & current) {
+    return impl_.cmp(current, key);
+  }));
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::iterator Map<K, V, Comparator>::upper_bound(const K & key)
+{
+  return make_iterator(map_details::partition_point(impl_.root, [this, &key] (const K & current) {
+    return !impl_.cmp(key, current);
+  }));
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::const_iterator Map<K, V, Comparator>::upper_bound(const K & key) const
+{
+  return make_iterator(map_details::partition_point(impl_.root, [this, &key] (const K & current) {
+    return !impl_.cmp(key, current);
+  }));
+}
+
+template <typename K, typename V, typename Comparator>
+std::pair<typename Map<K, V, Comparator>::iterator, typename Map<K, V, Comparator>::iterator>
+Map<K, V, Comparator>::equal_range(const K & key)
+{
+  return { lower_bound(key), upper_bound(key) };
+}
+
+template <typename K, typename V, typename Comparator>
+std::pair<typename Map<K, V, Comparator>::const_iterator, typename Map<K, V, Comparator>::const_iterator>
+Map<K, V, Comparator>::equal_range(const K & key) const
+{
+  return { lower_bound(key), upper_bound(key) };
+}
+
+namespace map_details
+{
+  template <typename K, typename V, typename Comparator>
+  std::pair<map_details::node_ptr<K, V, Comparator>, map_details::node_ptr<K, V, Comparator>>
+  prefix_range(map_details::node_ptr<K, V, Comparator> root, std::string_view prefix);
+}
+
+template <typename K, typename V, typename Comparator>
+std::pair<typename Map<K, V, Comparator>::iterator, typename Map<K, V, Comparator>::iterator>
+Map<K, V, Comparator>::prefix_range(std::string_view prefix)
+{
+  auto range = map_details::prefix_range<K, V, Comparator>(impl_.root, prefix);
+  return { make_iterator(range.first), make_iterator(range.second) };
+}
+
+template <typename K, typename V, typename Comparator>
+std::pair<typename Map<K, V, Comparator>::const_iterator, typename Map<K, V, Comparator>::const_iterator>
+Map<K, V, Comparator>::prefix_range(std::string_view prefix) const
+{
+  auto range = map_details::prefix_range<K, V, Comparator>(impl_.root, prefix);
+  return { make_iterator(range.first), make_iterator(range.second) };
+}
+
+template <typename K, typename V, typename Comparator>
+std::size_t Map<K, V, Comparator>::size() const
+{
+  return map_details::subtree_size<K, V, Comparator>(impl_.root);
+}
+
+template <typename K, typename V, typename Comparator>
+std::size_t Map<K, V, Comparator>::rank(const K & key) const
+{
+  auto rank = std::size_t{ 0u };
+  for (auto current = impl_.root; current; ) {
+    if (impl_.cmp(current->key, key)) {
+      rank += map_details::subtree_size<K, V, Comparator>(current->left) + 1u;
+      current = current->right;
+    } else {
+      current = current->left;
+    }
   }
+  return rank;
 }
 
 namespace map_details
 {
   template <typename K, typename V, typename Comparator>
-  map_details::node_ptr<K, V>
-  find(const K & key, map_details::node_ptr<K, V> root, const Comparator & cmp = Comparator{ });
+  map_details::node_ptr<K, V, Comparator> select(map_details::node_ptr<K, V, Comparator> root, std::size_t position);
 }
 
 template <typename K, typename V, typename Comparator>
-bool Map<K, V, Comparator>::contains(const K & key)
+typename Map<K, V, Comparator>::iterator Map<K, V, Comparator>::select(std::size_t position)
 {
-  return map_details::find(key, impl_.root, impl_.cmp);
+  return make_iterator(map_details::select(impl_.root, position));
 }
 
 template <typename K, typename V, typename Comparator>
-V & Map<K, V, Comparator>::operator[](const K & key)
+typename Map<K, V, Comparator>::const_iterator Map<K, V, Comparator>::select(std::size_t position) const
 {
-  auto node = map_details::find(key, impl_.root, impl_.cmp);
-  if (node) {
-    return node->value;
+  return make_iterator(map_details::select(impl_.root, position));
+}
+
+template <typename K, typename V, typename Comparator>
+std::size_t Map<K, V, Comparator>::count_range(const K & lower, const K & upper) const
+{
+  if (!impl_.cmp(lower, upper)) {
+    return 0u;
   }
-  throw std::invalid_argument{ "No such key in map!" };
+  return rank(upper) - rank(lower);
+}
+
+namespace map_details
+{
+  template <typename NodePtr, typename Visitor>
+  void for_each_node(NodePtr root, Visitor visit);
 }
 
 template <typename K, typename V, typename Comparator>
-const V & Map<K, V, Comparator>::operator[](const K & key) const
+template <typename Visitor>
+void Map<K, V, Comparator>::for_each(Visitor visit)
 {
-  auto node = map_details::find(key, impl_.root, impl_.cmp);
-  if (node) {
-    return node->value;
+  map_details::for_each_node(impl_.root, [&visit] (map_details::node_ptr<K, V, Comparator> node) {
+    visit(static_cast<const K &>(node->key), node->value);
+  });
+}
+
+template <typename K, typename V, typename Comparator>
+template <typename Visitor>
+void Map<K, V, Comparator>::for_each(Visitor visit) const
+{
+  map_details::for_each_node(map_details::const_node_ptr<K, V, Comparator>{ impl_.root }, [&visit] (map_details::const_node_ptr<K, V, Comparator> node) {
+    visit(node->key, node->value);
+  });
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::iterator Map<K, V, Comparator>::make_iterator(map_details::node_t<K, V, Comparator> * node)
+{
+  return node ? iterator(node) : end();
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::const_iterator
+Map<K, V, Comparator>::make_iterator(const map_details::node_t<K, V, Comparator> * node) const
+{
+  return node ? const_iterator(node) : end();
+}
+
+template <typename K, typename V, typename Comparator>
+void Map<K, V, Comparator>::ensure_header()
+{
+  if (!impl_.header) {
+    impl_.header = std::make_unique<map_details::header_t<K, V, Comparator>>();
   }
-  throw std::invalid_argument{ "No such key in map!" };
 }
 
 template <typename K, typename V, typename Comparator>
-typename Map<K, V, Comparator>::iterator Map<K, V, Comparator>::begin()
+void Map<K, V, Comparator>::attach_root()
 {
-  auto c = impl_.root;
-  while (c->left) {
-    c = c->left;
+  if (impl_.root) {
+    impl_.root->set_header(impl_.header.get());
   }
-  return iterator(c);
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::iterator Map<K, V, Comparator>::begin()
+{
+  return impl_.header ? make_iterator(impl_.header->leftmost) : iterator(nullptr);
 }
 
 template <typename K, typename V, typename Comparator>
 typename Map<K, V, Comparator>::iterator Map<K, V, Comparator>::end()
 {
-  return iterator(nullptr);
+  return impl_.header ? iterator::past(impl_.header.get()) : iterator(nullptr);
 }
 
 template <typename K, typename V, typename Comparator>
 typename Map<K, V, Comparator>::const_iterator Map<K, V, Comparator>::begin() const
 {
-  auto c = impl_.root;
-  while (c->left) {
-    c = c->left;
-  }
-  return const_iterator(c);
+  return impl_.header ? make_iterator(map_details::const_node_ptr<K, V, Comparator>{ impl_.header->leftmost })
+      : const_iterator(nullptr);
 }
 
 template <typename K, typename V, typename Comparator>
 typename Map<K, V, Comparator>::const_iterator Map<K, V, Comparator>::end() const
 {
-  return const_iterator(nullptr);
+  return impl_.header ? const_iterator::past(impl_.header.get()) : const_iterator(nullptr);
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::reverse_iterator Map<K, V, Comparator>::rbegin()
+{
+  return reverse_iterator(iterator(impl_.header ? impl_.header->rightmost : nullptr));
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::reverse_iterator Map<K, V, Comparator>::rend()
+{
+  return reverse_iterator(iterator(nullptr));
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::const_reverse_iterator Map<K, V, Comparator>::rbegin() const
+{
+  return const_reverse_iterator(const_iterator(impl_.header ? impl_.header->rightmost : nullptr));
+}
+
+template <typename K, typename V, typename Comparator>
+typename Map<K, V, Comparator>::const_reverse_iterator Map<K, V, Comparator>::rend() const
+{
+  return const_reverse_iterator(const_iterator(nullptr));
+}
+
+namespace map_details
+{
+  template <typename K, typename V, typename Comparator>
+  bool is_valid_subtree(map_details::const_node_ptr<K, V, Comparator> node, const Comparator & cmp,
+      const K * lower, const K * upper, std::size_t & black_height);
+}
+
+template <typename K, typename V, typename Comparator>
+bool Map<K, V, Comparator>::is_valid() const
+{
+  auto black_height = std::size_t{ 0u };
+  if (impl_.root && ((impl_.root->color() != map_details::BLACK) || (impl_.root->header() != impl_.header.get()))) {
+    return false;
+  }
+  auto leftmost = impl_.root;
+  auto rightmost = impl_.root;
+  while (leftmost && leftmost->left) {
+    leftmost = leftmost->left;
+  }
+  while (rightmost && rightmost->right) {
+    rightmost = rightmost->right;
+  }
+  if (!impl_.header) {
+    return !impl_.root;
+  }
+  if ((leftmost != impl_.header->leftmost) || (rightmost != impl_.header->rightmost)) {
+    return false;
+  }
+  return map_details::is_valid_subtree<K, V, Comparator>(impl_.root, impl_.cmp, nullptr, nullptr, black_height);
 }
 
 namespace map_details
 {
 
-  template <typename K, typename V>
-  void recursive_delete(map_details::node_ptr<K, V> node)
+  // Hands every node to dispose once. Left children are rotated up until the root has none,
+  // then the root is disposed of, so the walk needs no recursion or stack.
+  template <typename K, typename V, typename Comparator, typename Dispose>
+  void dispose_tree(map_details::node_ptr<K, V, Comparator> root, Dispose dispose)
   {
-    if (node->left) {
-      recursive_delete(node->left);
+    while (root) {
+      if (root->left) {
+        auto left = root->left;
+        root->left = left->right;
+        left->right = root;
+        root = left;
+      } else {
+        auto right = root->right;
+        dispose(root);
+        root = right;
+      }
     }
-    if (node->right) {
-      recursive_delete(node->right);
+  }
+
+  // Runs node destructors only, the memory itself is released or reused with the pool slabs
+  template <typename K, typename V, typename Comparator>
+  void destroy_tree(map_details::node_ptr<K, V, Comparator> root)
+  {
+    if constexpr (!std::is_trivially_destructible<map_details::node_t<K, V, Comparator>>::value) {
+      dispose_tree(root, [ ] (map_details::node_ptr<K, V, Comparator> node) { node->~node_t(); });
+    }
+  }
+
+  template <typename K, typename V, typename Comparator, typename KeyLike>
+  map_details::search_result_t<K, V, Comparator>
+  search(const KeyLike & key, map_details::node_ptr<K, V, Comparator> root, const Comparator & cmp)
+  {
+    constexpr auto three_way = uses_three_way_compare<Comparator, K, KeyLike>::value;
+    auto parent = map_details::node_ptr<K, V, Comparator>{ nullptr };
+    auto left = false;
+    if constexpr (three_way && key_prefix_t<K, Comparator>::enabled) {
+      auto prefix = make_key_prefix(key);
+      for (auto current = root; current; current = left ? current->left : current->right) {
+        auto order = (prefix != current->prefix) ? ((prefix < current->prefix) ? -1 : 1)
+            : three_way_compare<Comparator>::compare(cmp, key, current->key);
+        if (order == 0) {
+          return { current, nullptr, false };
+        }
+        parent = current;
+        left = order < 0;
+      }
+    } else if constexpr (three_way) {
+      for (auto current = root; current; current = left ? current->left : current->right) {
+        auto order = three_way_compare<Comparator>::compare(cmp, key, current->key);
+        if (order == 0) {
+          return { current, nullptr, false };
+        }
+        parent = current;
+        left = order < 0;
+      }
+    } else {
+      // One comparison per level: keep the last node not less than the key
+      // and check it for equivalence once at the bottom of the tree.
+      auto candidate = map_details::node_ptr<K, V, Comparator>{ nullptr };
+      for (auto current = root; current; current = left ? current->left : current->right) {
+        parent = current;
+        left = !cmp(current->key, key);
+        if (left) {
+          candidate = current;
+        }
+      }
+      if (candidate && !cmp(key, candidate->key)) {
+        return { candidate, nullptr, false };
+      }
+    }
+    return { nullptr, parent, left };
+  }
+
+  template <typename K, typename V, typename Comparator, typename KeyLike>
+  map_details::node_ptr<K, V, Comparator> find(const KeyLike & key, map_details::node_ptr<K, V, Comparator> root, const Comparator & cmp)
+  {
+    return search(key, root, cmp).found;
+  }
+
+  template <typename K, typename V, typename Comparator>
+  map_details::node_ptr<K, V, Comparator> link_balanced(map_details::node_ptr<K, V, Comparator> * nodes, std::size_t count,
+      map_details::node_ptr<K, V, Comparator> parent, std::size_t depth, std::size_t red_depth)
+  {
+    if (!count) {
+      return nullptr;
     }
-    delete node;
+    auto middle = count / 2u;
+    auto node = nodes[middle];
+    node->set_parent(parent);
+    node->set_color((depth == red_depth) ? RED : BLACK);
+    node->left = link_balanced(nodes, middle, node, depth + 1u, red_depth);
+    node->right = link_balanced(nodes + middle + 1u, count - middle - 1u, node, depth + 1u, red_depth);
+    node->size = static_cast<std::uint32_t>(count);
+    return node;
+  }
+
+  // First node in order whose key is not before(key), before must hold for a leading run of keys
+  template <typename K, typename V, typename Comparator, typename Predicate>
+  map_details::node_ptr<K, V, Comparator> partition_point(map_details::node_ptr<K, V, Comparator> root, Predicate before)
+  {
+    auto result = map_details::node_ptr<K, V, Comparator>{ nullptr };
+    for (auto current = root; current; ) {
+      if (before(current->key)) {
+        current = current->right;
+      } else {
+        result = current;
+        current = current->left;
+      }
+    }
+    return result;
+  }
+
+  // Keys starting with prefix are contiguous in lexicographic order: the range begins at the first key
+  // not less than prefix and ends at the first key whose leading prefix.size() bytes exceed prefix
+  template <typename K, typename V, typename Comparator>
+  std::pair<map_details::node_ptr<K, V, Comparator>, map_details::node_ptr<K, V, Comparator>>
+  prefix_range(map_details::node_ptr<K, V, Comparator> root, std::string_view prefix)
+  {
+    static_assert(key_prefix_t<K, Comparator>::enabled,
+        "Prefix queries need string-like keys in lexicographic order");
+    auto first = partition_point(root, [prefix] (const K & key) {
+      return std::string_view{ key } < prefix;
+    });
+    auto last = partition_point(root, [prefix] (const K & key) {
+      return std::string_view{ key }.substr(0u, prefix.size()) <= prefix;
+    });
+    return { first, last };
   }
 
   template <typename K, typename V, typename Comparator>
-  map_details::node_ptr<K, V> find(const K & key, map_details::node_ptr<K, V> root, const Comparator & cmp)
+  map_details::node_ptr<K, V, Comparator> select(map_details::node_ptr<K, V, Comparator> root, std::size_t position)
   {
+    if (position >= subtree_size<K, V, Comparator>(root)) {
+      throw std::out_of_range{ "Position is out of map range!" };
+    }
     auto current = root;
-    while (current && (current->key != key)) {
-      current = cmp(current->key, key) ? current->right : current->left;
+    for (auto left = subtree_size<K, V, Comparator>(current->left); left != position; left = subtree_size<K, V, Comparator>(current->left)) {
+      if (position < left) {
+        current = current->left;
+      } else {
+        position -= left + 1u;
+        current = current->right;
+      }
     }
     return current;
   }
 
-  template <typename K, typename V>
-  void insert_case_1(map_details::node_ptr<K, V> n);
+  // Enough for any tree whose size fits in std::size_t
+  constexpr std::size_t MAX_HEIGHT = 2u * 8u * sizeof(std::size_t);
+
+  template <typename NodePtr, typename Visitor>
+  void for_each_node(NodePtr root, Visitor visit)
+  {
+    NodePtr path[MAX_HEIGHT];
+    auto depth = std::size_t{ 0u };
+    for (auto current = root; current || depth; current = current->right) {
+      for (; current; current = current->left) {
+        path[depth++] = current;
+      }
+      current = path[--depth];
+      visit(current);
+    }
+  }
+
+  template <typename K, typename V, typename Comparator>
+  void collect_in_order(map_details::node_ptr<K, V, Comparator> root, std::vector<map_details::node_ptr<K, V, Comparator>> & nodes)
+  {
+    auto path = std::vector<map_details::node_ptr<K, V, Comparator>>{ };
+    for (auto current = root; current || !path.empty(); current = current->right) {
+      for (; current; current = current->left) {
+        path.push_back(current);
+      }
+      current = path.back();
+      path.pop_back();
+      nodes.push_back(current);
+    }
+  }
+
+  // Links sorted nodes into a tree of minimal height. Every level but the last one is full,
+  // so colouring only the last level red keeps the black height equal on all paths.
+  template <typename K, typename V, typename Comparator>
+  map_details::node_ptr<K, V, Comparator> link_balanced(map_details::node_ptr<K, V, Comparator> * nodes, std::size_t count)
+  {
+    auto red_depth = std::size_t{ 0u };
+    while ((std::size_t{ 2u } << red_depth) <= count + 1u) {
+      ++red_depth;
+    }
+    return link_balanced(nodes, count, map_details::node_ptr<K, V, Comparator>{ nullptr }, 0u, red_depth);
+  }
+
+  template <typename K, typename V, typename Comparator>
+  bool is_valid_subtree(map_details::const_node_ptr<K, V, Comparator> node, const Comparator & cmp,
+      const K * lower, const K * upper, std::size_t & black_height)
+  {
+    if (!node) {
+      black_height = 1u;
+      return true;
+    }
+    auto left_height = std::size_t{ 0u };
+    auto right_height = std::size_t{ 0u };
+    for (auto child : { node->left, node->right }) {
+      if (child && ((child->parent() != node) || ((node->color() == RED) && (child->color() == RED)))) {
+        return false;
+      }
+    }
+    if ((lower && !cmp(*lower, node->key)) || (upper && !cmp(node->key, *upper))) {
+      return false;
+    }
+    if (node->size != 1u + subtree_size<K, V, Comparator>(node->left) + subtree_size<K, V, Comparator>(node->right)) {
+      return false;
+    }
+    if (!is_valid_subtree<K, V, Comparator>(node->left, cmp, lower, &node->key, left_height)
+        || !is_valid_subtree<K, V, Comparator>(node->right, cmp, &node->key, upper, right_height)
+        || (left_height != right_height)) {
+      return false;
+    }
+    black_height = left_height + ((node->color() == BLACK) ? 1u : 0u);
+    return true;
+  }
+
+  template <typename K, typename V, typename Comparator>
+  void rotate_left(map_details::node_ptr<K, V, Comparator> n);
+
+  template <typename K, typename V, typename Comparator>
+  void rotate_right(map_details::node_ptr<K, V, Comparator> n);
+
+  template <typename K, typename V, typename Comparator>
+  void insert_case_1(map_details::node_ptr<K, V, Comparator> n);
+
+  // Puts v in place of u under the parent of u, the children of u are left to the caller
+  template <typename K, typename V, typename Comparator>
+  void transplant(map_details::node_ptr<K, V, Comparator> & root, map_details::node_ptr<K, V, Comparator> u, map_details::node_ptr<K, V, Comparator> v)
+  {
+    auto p = u->parent();
+    if (!p) {
+      root = v;
+    } else if (p->left == u) {
+      p->left = v;
+    } else {
+      p->right = v;
+    }
+    if (v) {
+      v->set_parent(p);
+    }
+  }
+
+  template <typename K, typename V, typename Comparator>
+  void rotate_left(map_details::node_ptr<K, V, Comparator> & root, map_details::node_ptr<K, V, Comparator> n)
+  {
+    rotate_left(n);
+    if (root == n) {
+      root = n->parent();
+    }
+  }
+
+  template <typename K, typename V, typename Comparator>
+  void rotate_right(map_details::node_ptr<K, V, Comparator> & root, map_details::node_ptr<K, V, Comparator> n)
+  {
+    rotate_right(n);
+    if (root == n) {
+      root = n->parent();
+    }
+  }
+
+  template <typename K, typename V, typename Comparator>
+  bool is_black(map_details::node_ptr<K, V, Comparator> n)
+  {
+    return !n || (n->color() == BLACK);
+  }
+
+  // Restores the red-black properties after a black node was removed above x, which may be null,
+  // so its parent is passed separately. Mirrors of the four classic cases share one loop.
+  template <typename K, typename V, typename Comparator>
+  void erase_fixup(map_details::node_ptr<K, V, Comparator> & root, map_details::node_ptr<K, V, Comparator> x, map_details::node_ptr<K, V, Comparator> p)
+  {
+    while ((x != root) && is_black(x)) {
+      if (x == p->left) {
+        auto w = p->right;
+        if (w->color() == RED) {
+          w->set_color(BLACK);
+          p->set_color(RED);
+          rotate_left(root, p);
+          w = p->right;
+        }
+        if (is_black(w->left) && is_black(w->right)) {
+          w->set_color(RED);
+          x = p;
+          p = x->parent();
+        } else {
+          if (is_black(w->right)) {
+            w->left->set_color(BLACK);
+            w->set_color(RED);
+            rotate_right(root, w);
+            w = p->right;
+          }
+          w->set_color(p->color());
+          p->set_color(BLACK);
+          w->right->set_color(BLACK);
+          rotate_left(root, p);
+          x = root;
+        }
+      } else {
+        auto w = p->left;
+        if (w->color() == RED) {
+          w->set_color(BLACK);
+          p->set_color(RED);
+          rotate_right(root, p);
+          w = p->left;
+        }
+        if (is_black(w->left) && is_black(w->right)) {
+          w->set_color(RED);
+          x = p;
+          p = x->parent();
+        } else {
+          if (is_black(w->left)) {
+            w->right->set_color(BLACK);
+            w->set_color(RED);
+            rotate_left(root, w);
+            w = p->left;
+          }
+          w->set_color(p->color());
+          p->set_color(BLACK);
+          w->left->set_color(BLACK);
+          rotate_right(root, p);
+          x = root;
+        }
+      }
+    }
+    if (x) {
+      x->set_color(BLACK);
+    }
+  }
+
+  // Unlinks z from the tree rooted at root. A node with two children is replaced by its
+  // successor node rather than by its value, so iterators to other elements stay valid.
+  template <typename K, typename V, typename Comparator>
+  void erase_node(map_details::node_ptr<K, V, Comparator> & root, map_details::node_ptr<K, V, Comparator> z)
+  {
+    auto removed_color = z->color();
+    auto x = map_details::node_ptr<K, V, Comparator>{ nullptr };
+    auto p = z->parent();
+    // Every ancestor of the place the node is unlinked from loses one node
+    auto unlinked = (z->left && z->right) ? z->right : z;
+    while (unlinked != z && unlinked->left) {
+      unlinked = unlinked->left;
+    }
+    for (auto ancestor = unlinked->parent(); ancestor; ancestor = ancestor->parent()) {
+      --ancestor->size;
+    }
+    if (!z->left) {
+      x = z->right;
+      transplant(root, z, x);
+    } else if (!z->right) {
+      x = z->left;
+      transplant(root, z, x);
+    } else {
+      auto y = z->right;
+      while (y->left) {
+        y = y->left;
+      }
+      removed_color = y->color();
+      x = y->right;
+      if (y->parent() == z) {
+        p = y;
+      } else {
+        p = y->parent();
+        transplant(root, y, x);
+        y->right = z->right;
+        y->right->set_parent(y);
+      }
+      transplant(root, z, y);
+      y->left = z->left;
+      y->left->set_parent(y);
+      y->set_color(z->color());
+      y->size = z->size;
+    }
+    if (removed_color == BLACK) {
+      erase_fixup(root, x, p);
+    }
+  }
+
+  // Number of black nodes on any path from n down to a leaf
+  template <typename K, typename V, typename Comparator>
+  std::size_t black_height(map_details::node_ptr<K, V, Comparator> n)
+  {
+    auto height = std::size_t{ 0u };
+    for (; n; n = n->left) {
+      height += (n->color() == BLACK) ? 1u : 0u;
+    }
+    return height;
+  }
+
+  // Cuts a child off as a tree of its own, a red root is repainted black
+  template <typename K, typename V, typename Comparator>
+  map_details::node_ptr<K, V, Comparator> detach(map_details::node_ptr<K, V, Comparator> n)
+  {
+    if (n) {
+      n->set_parent(nullptr);
+      n->set_color(BLACK);
+    }
+    return n;
+  }
+
+  // Joins trees with black roots whose keys all order before and after the key of the detached node
+  // middle. The middle node is hung off the spine of the taller tree at the black height of the
+  // other one and the red-red violation, if any, is fixed as after an insertion.
+  template <typename K, typename V, typename Comparator>
+  map_details::node_ptr<K, V, Comparator> join(map_details::node_ptr<K, V, Comparator> left, map_details::node_ptr<K, V, Comparator> middle,
+      map_details::node_ptr<K, V, Comparator> right)
+  {
+    auto left_height = black_height(left);
+    auto right_height = black_height(right);
+    if (left_height == right_height) {
+      middle->left = left;
+      middle->right = right;
+      middle->set_parent(nullptr);
+      middle->set_color(BLACK);
+      update_size(middle);
+      for (auto child : { left, right }) {
+        if (child) {
+          child->set_parent(middle);
+        }
+      }
+      return middle;
+    }
+    auto taller = (left_height > right_height);
+    auto height = taller ? left_height : right_height;
+    auto target = taller ? right_height : left_height;
+    auto parent = map_details::node_ptr<K, V, Comparator>{ nullptr };
+    auto current = taller ? left : right;
+    while (current && ((current->color() == RED) || (height != target))) {
+      height -= (current->color() == BLACK) ? 1u : 0u;
+      parent = current;
+      current = taller ? current->right : current->left;
+    }
+    auto shorter = taller ? right : left;
+    middle->left = taller ? current : shorter;
+    middle->right = taller ? shorter : current;
+    middle->set_parent(parent);
+    middle->set_color(RED);
+    for (auto child : { middle->left, middle->right }) {
+      if (child) {
+        child->set_parent(middle);
+      }
+    }
+    update_size(middle);
+    if (taller) {
+      parent->right = middle;
+    } else {
+      parent->left = middle;
+    }
+    for (auto ancestor = parent; ancestor; ancestor = ancestor->parent()) {
+      ancestor->size += static_cast<std::uint32_t>(subtree_size<K, V, Comparator>(shorter) + 1u);
+    }
+    insert_case_1(middle);
+    auto root = middle;
+    while (root->parent()) {
+      root = root->parent();
+    }
+    return root;
+  }
+
+  template <typename K, typename V, typename Comparator>
+  map_details::node_ptr<K, V, Comparator> join(map_details::node_ptr<K, V, Comparator> left, map_details::node_ptr<K, V, Comparator> right)
+  {
+    if (!left || !right) {
+      return left ? left : right;
+    }
+    auto middle = right;
+    while (middle->left) {
+      middle = middle->left;
+    }
+    erase_node(right, middle);
+    return join(left, middle, detach(right));
+  }
+
+  // Splits a tree into the nodes ordered before key and the rest, both with black roots
+  template <typename K, typename V, typename Comparator>
+  std::pair<map_details::node_ptr<K, V, Comparator>, map_details::node_ptr<K, V, Comparator>>
+  split(map_details::node_ptr<K, V, Comparator> root, const K & key, const Comparator & cmp)
+  {
+    if (!root) {
+      return { nullptr, nullptr };
+    }
+    auto left = detach(root->left);
+    auto right = detach(root->right);
+    if (cmp(root->key, key)) {
+      auto parts = split(right, key, cmp);
+      return { join(left, root, parts.first), parts.second };
+    }
+    auto parts = split(left, key, cmp);
+    return { parts.first, join(parts.second, root, right) };
+  }
 
-  template <typename K, typename V>
-  void insert_node(map_details::node_ptr<K, V> node)
+  template <typename K, typename V, typename Comparator>
+  void insert_node(map_details::node_ptr<K, V, Comparator> node)
   {
     insert_case_1(node);
   }
 
-  template <typename K, typename V>
-  void insert_case_2(map_details::node_ptr<K, V> n);
+  template <typename K, typename V, typename Comparator>
+  void insert_case_2(map_details::node_ptr<K, V, Comparator> n);
 
-  template <typename K, typename V>
-  void insert_case_1(map_details::node_ptr<K, V> n)
+  template <typename K, typename V, typename Comparator>
+  void insert_case_1(map_details::node_ptr<K, V, Comparator> n)
   {
-    if (!n->parent) {
-      n->color = BLACK;
+    if (!n->parent()) {
+      n->set_color(BLACK);
     } else {
       insert_case_2(n);
     }
   }
 
-  template <typename K, typename V>
-  void insert_case_3(map_details::node_ptr<K, V> n);
+  template <typename K, typename V, typename Comparator>
+  void insert_case_3(map_details::node_ptr<K, V, Comparator> n);
 
-  template <typename K, typename V>
-  void insert_case_2(map_details::node_ptr<K, V> n)
+  template <typename K, typename V, typename Comparator>
+  void insert_case_2(map_details::node_ptr<K, V, Comparator> n)
   {
-    if (n->parent->color != BLACK) {
+    if (n->parent()->color() != BLACK) {
       insert_case_3(n);
     }
   }
 
-  template <typename K, typename V>
-  map_details::node_ptr<K, V> grandparent(map_details::node_ptr<K, V> n);
+  template <typename K, typename V, typename Comparator>
+  map_details::node_ptr<K, V, Comparator> grandparent(map_details::node_ptr<K, V, Comparator> n);
 
-  template <typename K, typename V>
-  map_details::node_ptr<K, V> uncle(map_details::node_ptr<K, V> n);
+  template <typename K, typename V, typename Comparator>
+  map_details::node_ptr<K, V, Comparator> uncle(map_details::node_ptr<K, V, Comparator> n);
 
-  template <typename K, typename V>
-  void insert_case_4(map_details::node_ptr<K, V> n);
+  template <typename K, typename V, typename Comparator>
+  void insert_case_4(map_details::node_ptr<K, V, Comparator> n);
 
-  template <typename K, typename V>
-  void insert_case_3(map_details::node_ptr<K, V> n)
+  template <typename K, typename V, typename Comparator>
+  void insert_case_3(map_details::node_ptr<K, V, Comparator> n)
   {
     auto u = uncle(n);
-    if (u && (u->color == RED)) {
-      n->parent->color = BLACK;
-      u->color = BLACK;
+    if (u && (u->color() == RED)) {
+      n->parent()->set_color(BLACK);
+      u->set_color(BLACK);
       auto gp = grandparent(n);
-      gp->color = RED;
+      gp->set_color(RED);
       insert_case_1(gp);
     } else {
       insert_case_4(n);
     }
   }
 
-  template <typename K, typename V>
-  void rotate_left(map_details::node_ptr<K, V> n);
+  template <typename K, typename V, typename Comparator>
+  void rotate_left(map_details::node_ptr<K, V, Comparator> n);
 
-  template <typename K, typename V>
-  void rotate_right(map_details::node_ptr<K, V> n);
+  template <typename K, typename V, typename Comparator>
+  void rotate_right(map_details::node_ptr<K, V, Comparator> n);
 
-  template <typename K, typename V>
-  void insert_case_5(map_details::node_ptr<K, V> n);
+  template <typename K, typename V, typename Comparator>
+  void insert_case_5(map_details::node_ptr<K, V, Comparator> n);
 
-  template <typename K, typename V>
-  void insert_case_4(map_details::node_ptr<K, V> n)
+  template <typename K, typename V, typename Comparator>
+  void insert_case_4(map_details::node_ptr<K, V, Comparator> n)
   {
-    auto p = n->parent;
+    auto p = n->parent();
     auto gp = grandparent(n);
     if ((n == p->right) && (p == gp->left)) {
       rotate_left(p);
@@ -454,10 +2005,10 @@ namespace map_details
     insert_case_5(n);
   }
 
-  template <typename K, typename V>
-  void insert_case_5(map_details::node_ptr<K, V> n)
+  template <typename K, typename V, typename Comparator>
+  void insert_case_5(map_details::node_ptr<K, V, Comparator> n)
   {
-    auto p = n->parent;
+    auto p = n->parent();
     auto gp = grandparent(n);
 
     if ((n == p->left) && (p == gp->left)) {
@@ -466,37 +2017,39 @@ namespace map_details
       rotate_left(gp);
     }
 
-    p->color = BLACK;
-    gp->color = RED;
+    p->set_color(BLACK);
+    gp->set_color(RED);
   }
 
-  template <typename K, typename V>
-  map_details::node_ptr<K, V> grandparent(map_details::node_ptr<K, V> n)
+  template <typename K, typename V, typename Comparator>
+  map_details::node_ptr<K, V, Comparator> grandparent(map_details::node_ptr<K, V, Comparator> n)
   {
-    return (n && n->parent) ? n->parent->parent : nullptr;
+    return (n && n->parent()) ? n->parent()->parent() : nullptr;
   }
 
-  template <typename K, typename V>
-  map_details::node_ptr<K, V> uncle(map_details::node_ptr<K, V> n)
+  template <typename K, typename V, typename Comparator>
+  map_details::node_ptr<K, V, Comparator> uncle(map_details::node_ptr<K, V, Comparator> n)
   {
     auto gp = grandparent(n);
     return gp ?
-        (gp->left == n->parent) ? gp->right : gp->left
+        (gp->left == n->parent()) ? gp->right : gp->left
         : nullptr;
   }
 
-  template <typename K, typename V>
-  void rotate_left(map_details::node_ptr<K, V> n)
+  template <typename K, typename V, typename Comparator>
+  void rotate_left(map_details::node_ptr<K, V, Comparator> n)
   {
     auto pivot = n->right;
-    auto p = n->parent;
+    auto p = n->parent();
 
     n->right = pivot->left;
     pivot->left = n;
-    n->parent = pivot;
+    n->set_parent(pivot);
+    pivot->size = n->size;
+    update_size(n);
 
     if (n->right) {
-      n->right->parent = n;
+      n->right->set_parent(n);
     }
 
     if (p) {
@@ -507,21 +2060,23 @@ namespace map_details
       }
     }
 
-    pivot->parent = p;
+    pivot->set_parent(p);
   }
 
-  template <typename K, typename V>
-  void rotate_right(map_details::node_ptr<K, V> n)
+  template <typename K, typename V, typename Comparator>
+  void rotate_right(map_details::node_ptr<K, V, Comparator> n)
   {
     auto pivot = n->left;
-    auto p = n->parent;
+    auto p = n->parent();
 
     n->left = pivot->right;
     pivot->right = n;
-    n->parent = pivot;
+    n->set_parent(pivot);
+    pivot->size = n->size;
+    update_size(n);
 
     if (n->left) {
-      n->left->parent = n;
+      n->left->set_parent(n);
     }
 
     if (p) {
@@ -532,7 +2087,7 @@ namespace map_details
       }
     }
 
-    pivot->parent = p;
+    pivot->set_parent(p);
   }
 
 }
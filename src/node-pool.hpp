@@ -0,0 +1,234 @@
+#ifndef CROSS_REFS_NODE_POOL
+#define CROSS_REFS_NODE_POOL
+
+#include <new>
+#include <memory>
+#include <iterator>
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
+
+namespace pool_details
+{
+  // Deals items out in order to parts runs of about equal total capacity
+  template <typename Item, typename CapacityFunction>
+  std::vector<std::vector<Item>> deal_by_capacity(std::vector<Item> & items, std::size_t parts, CapacityFunction capacity)
+  {
+    if (!parts) {
+      throw std::invalid_argument{ "Memory must be divided into at least one part" };
+    }
+    auto total = std::size_t{ 0u };
+    for (const auto & item : items) {
+      total += capacity(item);
+    }
+    auto runs = std::vector<std::vector<Item>>(parts);
+    auto dealt = std::size_t{ 0u };
+    auto k = std::size_t{ 0u };
+    for (auto & item : items) {
+      dealt += capacity(item);
+      runs[k].push_back(std::move(item));
+      if ((k + 1u < parts) && (dealt * parts >= total * (k + 1u))) {
+        ++k;
+      }
+    }
+    items.clear();
+    return runs;
+  }
+}
+
+// Fixed-size object pool carving nodes out of geometrically growing slabs, the first one holds
+// FirstSlabSize nodes. Destroyed nodes are recycled through a free list; release() drops every
+// slab at once, reset() keeps the slabs and carves them again from the first one.
+template <typename T, std::size_t FirstSlabSize = 16u>
+class NodePool
+{
+
+  public:
+
+    NodePool();
+
+    NodePool(const NodePool & other) = delete;
+
+    NodePool(NodePool && other) noexcept;
+
+    ~NodePool() = default;
+
+    NodePool & operator=(const NodePool & other) = delete;
+
+    NodePool & operator=(NodePool && other) noexcept;
+
+    template <typename... Args>
+    T * create(Args && ... args);
+
+    void destroy(T * node);
+
+    void release();
+
+    // Forgets every node without running destructors, the caller must have destroyed them
+    void reset();
+
+    void splice(NodePool && other);
+
+    // Deals the slabs out to parts pools of about equal capacity and leaves this pool empty,
+    // every node must have been destroyed or forgotten with reset() before
+    std::vector<NodePool> divide(std::size_t parts);
+
+  private:
+
+    union slot_t
+    {
+      slot_t * next;
+      alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    static constexpr std::size_t MAX_SLAB_SIZE = 4096u;
+
+    slot_t * allocate();
+
+    struct slab_t
+    {
+      std::unique_ptr<slot_t[]> slots;
+      std::size_t capacity;
+    };
+
+    // Slots are carved from slabs[current], the slabs after it are empty
+    struct PoolImpl
+    {
+      std::vector<slab_t> slabs;
+      std::size_t current;
+      std::size_t used;
+      slot_t * free;
+    };
+
+    PoolImpl impl_;
+
+};
+
+template <typename T, std::size_t FirstSlabSize>
+NodePool<T, FirstSlabSize>::NodePool() :
+    impl_{ { }, 0u, 0u, nullptr }
+{ }
+
+template <typename T, std::size_t FirstSlabSize>
+NodePool<T, FirstSlabSize>::NodePool(NodePool && other) noexcept :
+    impl_{ std::move(other.impl_) }
+{
+  other.impl_ = { { }, 0u, 0u, nullptr };
+}
+
+template <typename T, std::size_t FirstSlabSize>
+NodePool<T, FirstSlabSize> & NodePool<T, FirstSlabSize>::operator=(NodePool && other) noexcept
+{
+  impl_ = std::move(other.impl_);
+  other.impl_ = { { }, 0u, 0u, nullptr };
+  return *this;
+}
+
+template <typename T, std::size_t FirstSlabSize>
+template <typename... Args>
+T * NodePool<T, FirstSlabSize>::create(Args && ... args)
+{
+  auto slot = allocate();
+  try {
+    return new (slot->storage) T{ std::forward<Args>(args)... };
+  } catch (...) {
+    slot->next = impl_.free;
+    impl_.free = slot;
+    throw;
+  }
+}
+
+template <typename T, std::size_t FirstSlabSize>
+void NodePool<T, FirstSlabSize>::destroy(T * node)
+{
+  node->~T();
+  auto slot = reinterpret_cast<slot_t *>(node);
+  slot->next = impl_.free;
+  impl_.free = slot;
+}
+
+template <typename T, std::size_t FirstSlabSize>
+void NodePool<T, FirstSlabSize>::release()
+{
+  impl_ = { { }, 0u, 0u, nullptr };
+}
+
+template <typename T, std::size_t FirstSlabSize>
+void NodePool<T, FirstSlabSize>::reset()
+{
+  impl_.current = 0u;
+  impl_.used = 0u;
+  impl_.free = nullptr;
+}
+
+// Takes over the slabs and live nodes of other, which is left empty. Slabs other has not
+// carved from yet are queued after the current one, unused slots at the end of the slab
+// other was carving are not reused until the pool is reset or released.
+template <typename T, std::size_t FirstSlabSize>
+void NodePool<T, FirstSlabSize>::splice(NodePool && other)
+{
+  if (this == &other) {
+    return;
+  }
+  auto & slabs = other.impl_.slabs;
+  if (impl_.slabs.empty()) {
+    impl_.current = other.impl_.current;
+    impl_.used = other.impl_.used;
+    impl_.slabs = std::move(slabs);
+  } else {
+    auto carved = std::min(other.impl_.current + (other.impl_.used ? 1u : 0u), slabs.size());
+    impl_.current += carved;
+    impl_.slabs.insert(impl_.slabs.begin(), std::make_move_iterator(slabs.begin()),
+        std::make_move_iterator(slabs.begin() + carved));
+    impl_.slabs.insert(impl_.slabs.end(), std::make_move_iterator(slabs.begin() + carved),
+        std::make_move_iterator(slabs.end()));
+  }
+  if (other.impl_.free) {
+    auto last = other.impl_.free;
+    while (last->next) {
+      last = last->next;
+    }
+    last->next = impl_.free;
+    impl_.free = other.impl_.free;
+  }
+  other.impl_ = { { }, 0u, 0u, nullptr };
+}
+
+template <typename T, std::size_t FirstSlabSize>
+std::vector<NodePool<T, FirstSlabSize>> NodePool<T, FirstSlabSize>::divide(std::size_t parts)
+{
+  auto runs = pool_details::deal_by_capacity(impl_.slabs, parts, [ ] (const slab_t & slab) { return slab.capacity; });
+  auto pools = std::vector<NodePool>(parts);
+  for (std::size_t k = 0u; k < parts; ++k) {
+    pools[k].impl_.slabs = std::move(runs[k]);
+  }
+  impl_ = { { }, 0u, 0u, nullptr };
+  return pools;
+}
+
+template <typename T, std::size_t FirstSlabSize>
+typename NodePool<T, FirstSlabSize>::slot_t * NodePool<T, FirstSlabSize>::allocate()
+{
+  if (impl_.free) {
+    auto slot = impl_.free;
+    impl_.free = slot->next;
+    return slot;
+  }
+  if (impl_.slabs.empty()) {
+    impl_.slabs.push_back({ std::unique_ptr<slot_t[]>{ new slot_t[FirstSlabSize] }, FirstSlabSize });
+    impl_.current = 0u;
+    impl_.used = 0u;
+  } else if (impl_.used == impl_.slabs[impl_.current].capacity) {
+    if (impl_.current + 1u == impl_.slabs.size()) {
+      auto capacity = std::min(impl_.slabs.back().capacity * 2u, MAX_SLAB_SIZE);
+      impl_.slabs.push_back({ std::unique_ptr<slot_t[]>{ new slot_t[capacity] }, capacity });
+    }
+    ++impl_.current;
+    impl_.used = 0u;
+  }
+  return &impl_.slabs[impl_.current].slots[impl_.used++];
+}
+
+#endif
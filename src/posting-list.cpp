@@ -0,0 +1,131 @@
+#include "posting-list.hpp"
+
+#include <stdexcept>
+
+PostingList::PostingList() :
+    bytes_{ },
+    last_{ 0 },
+    size_{ 0u }
+{ }
+
+void PostingList::push_back(int line)
+{
+  if (size_ && (line <= last_)) {
+    if (line == last_) {
+      return;
+    }
+    throw std::invalid_argument{ "Line numbers must be added in ascending order" };
+  }
+  auto delta = static_cast<unsigned>(line) - static_cast<unsigned>(size_ ? last_ : 0);
+  while (delta >= 0x80u) {
+    bytes_.push_back(static_cast<unsigned char>(delta | 0x80u));
+    delta >>= 7u;
+  }
+  bytes_.push_back(static_cast<unsigned char>(delta));
+  last_ = line;
+  ++size_;
+}
+
+// Concatenates postings starting no earlier than back(), only the first delta is re-encoded
+void PostingList::append(const PostingList & other)
+{
+  if (other.empty()) {
+    return;
+  }
+  auto rest = other.bytes_.begin();
+  while (*rest & 0x80u) {
+    ++rest;
+  }
+  push_back(*other.begin());
+  bytes_.insert(bytes_.end(), rest + 1, other.bytes_.end());
+  last_ = other.last_;
+  size_ += other.size_ - 1u;
+}
+
+std::size_t PostingList::size() const
+{
+  return size_;
+}
+
+bool PostingList::empty() const
+{
+  return !size_;
+}
+
+int PostingList::back() const
+{
+  if (!size_) {
+    throw std::out_of_range{ "Can't peek at empty posting list" };
+  }
+  return last_;
+}
+
+PostingList::const_iterator PostingList::begin() const
+{
+  return const_iterator(bytes_.data(), bytes_.data() + bytes_.size(), 0);
+}
+
+PostingList::const_iterator PostingList::end() const
+{
+  auto end = bytes_.data() + bytes_.size();
+  return const_iterator(end, end, last_);
+}
+
+PostingList::const_iterator::const_iterator() :
+    pos_{ nullptr },
+    next_{ nullptr },
+    end_{ nullptr },
+    value_{ 0 }
+{ }
+
+PostingList::const_iterator::const_iterator(const unsigned char * pos, const unsigned char * end, int base) :
+    pos_{ pos },
+    next_{ pos },
+    end_{ end },
+    value_{ base }
+{
+  decode();
+}
+
+PostingList::const_iterator & PostingList::const_iterator::operator++()
+{
+  pos_ = next_;
+  decode();
+  return *this;
+}
+
+PostingList::const_iterator PostingList::const_iterator::operator++(int)
+{
+  auto t = *this;
+  ++(*this);
+  return t;
+}
+
+int PostingList::const_iterator::operator*() const
+{
+  return value_;
+}
+
+bool PostingList::const_iterator::operator==(const const_iterator & rhs) const
+{
+  return pos_ == rhs.pos_;
+}
+
+bool PostingList::const_iterator::operator!=(const const_iterator & rhs) const
+{
+  return pos_ != rhs.pos_;
+}
+
+void PostingList::const_iterator::decode()
+{
+  if (pos_ == end_) {
+    return;
+  }
+  auto delta = 0u;
+  auto shift = 0u;
+  for (next_ = pos_; *next_ & 0x80u; ++next_, shift += 7u) {
+    delta |= (*next_ & 0x7Fu) << shift;
+  }
+  delta |= static_cast<unsigned>(*next_++) << shift;
+  value_ = static_cast<int>(static_cast<unsigned>(value_) + delta);
+}
@@ -0,0 +1,71 @@
+#ifndef CROSS_REFS_POSTING_LIST
+#define CROSS_REFS_POSTING_LIST
+
+#include <vector>
+#include <cstddef>
+
+// Ascending list of line numbers stored as varint-encoded deltas in one buffer
+class PostingList
+{
+
+  public:
+
+    class const_iterator;
+
+    PostingList();
+
+    void push_back(int line);
+
+    void append(const PostingList & other);
+
+    std::size_t size() const;
+
+    bool empty() const;
+
+    int back() const;
+
+    const_iterator begin() const;
+
+    const_iterator end() const;
+
+  private:
+
+    std::vector<unsigned char> bytes_;
+
+    int last_;
+
+    std::size_t size_;
+
+};
+
+class PostingList::const_iterator
+{
+
+  public:
+
+    const_iterator();
+
+    const_iterator(const unsigned char * pos, const unsigned char * end, int base);
+
+    const_iterator & operator++();
+
+    const_iterator operator++(int);
+
+    int operator*() const;
+
+    bool operator==(const const_iterator & rhs) const;
+
+    bool operator!=(const const_iterator & rhs) const;
+
+  private:
+
+    void decode();
+
+    const unsigned char * pos_;
+    const unsigned char * next_;
+    const unsigned char * end_;
+    int value_;
+
+};
+
+#endif
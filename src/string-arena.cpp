@@ -0,0 +1,115 @@
+#include "string-arena.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <iterator>
+
+#include "node-pool.hpp"
+
+const std::size_t StringArena::CHUNK_SIZE = 1u << 16u;
+
+StringArena::StringArena() :
+    chunks_{ },
+    large_{ },
+    current_{ 0u },
+    used_{ 0u }
+{ }
+
+StringArena::StringArena(StringArena && other) noexcept :
+    chunks_{ std::move(other.chunks_) },
+    large_{ std::move(other.large_) },
+    current_{ other.current_ },
+    used_{ other.used_ }
+{
+  other.chunks_.clear();
+  other.large_.clear();
+  other.current_ = other.used_ = 0u;
+}
+
+StringArena & StringArena::operator=(StringArena && other) noexcept
+{
+  if (this == &other) {
+    return *this;
+  }
+  chunks_ = std::move(other.chunks_);
+  large_ = std::move(other.large_);
+  current_ = other.current_;
+  used_ = other.used_;
+  other.chunks_.clear();
+  other.large_.clear();
+  other.current_ = other.used_ = 0u;
+  return *this;
+}
+
+std::string_view StringArena::intern(std::string_view text)
+{
+  if (text.empty()) {
+    return { };
+  }
+  if (text.size() > CHUNK_SIZE / 4u) {
+    // Long strings get a chunk of their own, dropped on clear()
+    large_.emplace_back(new char[text.size()]);
+    auto data = large_.back().get();
+    std::memcpy(data, text.data(), text.size());
+    return { data, text.size() };
+  }
+  if (chunks_.empty()) {
+    chunks_.emplace_back(new char[CHUNK_SIZE]);
+    current_ = used_ = 0u;
+  } else if (CHUNK_SIZE - used_ < text.size()) {
+    if (current_ + 1u == chunks_.size()) {
+      chunks_.emplace_back(new char[CHUNK_SIZE]);
+    }
+    ++current_;
+    used_ = 0u;
+  }
+  auto data = chunks_[current_].get() + used_;
+  std::memcpy(data, text.data(), text.size());
+  used_ += text.size();
+  return { data, text.size() };
+}
+
+// Takes over the strings of other, views into them stay valid
+void StringArena::splice(StringArena && other)
+{
+  if (this == &other) {
+    return;
+  }
+  auto & chunks = other.chunks_;
+  if (chunks_.empty()) {
+    current_ = other.current_;
+    used_ = other.used_;
+    chunks_ = std::move(chunks);
+  } else {
+    // Chunks other has not filled yet are queued after the current one
+    auto filled = std::min(other.current_ + (other.used_ ? 1u : 0u), chunks.size());
+    current_ += filled;
+    chunks_.insert(chunks_.begin(), std::make_move_iterator(chunks.begin()),
+        std::make_move_iterator(chunks.begin() + filled));
+    chunks_.insert(chunks_.end(), std::make_move_iterator(chunks.begin() + filled),
+        std::make_move_iterator(chunks.end()));
+  }
+  large_.insert(large_.end(), std::make_move_iterator(other.large_.begin()),
+      std::make_move_iterator(other.large_.end()));
+  other.chunks_.clear();
+  other.large_.clear();
+  other.current_ = other.used_ = 0u;
+}
+
+void StringArena::clear()
+{
+  large_.clear();
+  current_ = used_ = 0u;
+}
+
+std::vector<StringArena> StringArena::divide(std::size_t parts)
+{
+  auto runs = pool_details::deal_by_capacity(chunks_, parts, [ ] (const std::unique_ptr<char[]> &) { return CHUNK_SIZE; });
+  clear();
+  auto arenas = std::vector<StringArena>(parts);
+  for (std::size_t k = 0u; k < parts; ++k) {
+    arenas[k].chunks_ = std::move(runs[k]);
+  }
+  return arenas;
+}
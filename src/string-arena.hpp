@@ -0,0 +1,53 @@
+#ifndef CROSS_REFS_STRING_ARENA
+#define CROSS_REFS_STRING_ARENA
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <string_view>
+
+// Append-only storage packing strings into large chunks. Views returned by intern()
+// stay valid until the arena is cleared or destroyed, moving the arena keeps them valid.
+// clear() keeps the regular chunks and fills them again from the first one.
+class StringArena
+{
+
+  public:
+
+    StringArena();
+
+    StringArena(const StringArena & other) = delete;
+
+    StringArena(StringArena && other) noexcept;
+
+    ~StringArena() = default;
+
+    StringArena & operator=(const StringArena & other) = delete;
+
+    StringArena & operator=(StringArena && other) noexcept;
+
+    std::string_view intern(std::string_view text);
+
+    void splice(StringArena && other);
+
+    void clear();
+
+    // Clears the arena and deals its chunks out evenly to parts empty arenas
+    std::vector<StringArena> divide(std::size_t parts);
+
+  private:
+
+    static const std::size_t CHUNK_SIZE;
+
+    // Strings are packed into chunks_[current_], the chunks after it are empty
+    std::vector<std::unique_ptr<char[]>> chunks_;
+
+    std::vector<std::unique_ptr<char[]>> large_;
+
+    std::size_t current_;
+
+    std::size_t used_;
+
+};
+
+#endif
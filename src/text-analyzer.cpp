@@ -1,75 +1,433 @@
 #include "text-analyzer.hpp"
 
-#include <regex>
 #include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <future>
+#include <thread>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string_view>
 #include <fstream>
 #include <iostream>
 #include <algorithm>
 #include <stdexcept>
 #include <functional>
 
-#include "list.hpp"
+#include "posting-list.hpp"
 #include "map.hpp"
+#include "tokenizer.hpp"
+#include "file-buffer.hpp"
+#include "string-arena.hpp"
+#include "hash-index.hpp"
 
 TextAnalyzer::TextAnalyzer() :
-    dictionary{ }
+    words{ },
+    dictionary{ },
+    threadCount{ 1u },
+    wordIndexCapacity{ NO_WORD_INDEX },
+    engine{ ORDERED_MAP },
+    stream{ }
 { }
 
 TextAnalyzer::TextAnalyzer(TextAnalyzer && other) noexcept:
-    dictionary{ std::move(other.dictionary) }
+    words{ std::move(other.words) },
+    dictionary{ std::move(other.dictionary) },
+    threadCount{ other.threadCount },
+    wordIndexCapacity{ other.wordIndexCapacity },
+    engine{ other.engine },
+    stream{ std::move(other.stream) }
 { }
 
+TextAnalyzer::~TextAnalyzer() = default;
+
 TextAnalyzer & TextAnalyzer::operator=(TextAnalyzer && other) noexcept
 {
+  stream = std::move(other.stream);
   dictionary = std::move(other.dictionary);
+  words = std::move(other.words);
+  threadCount = other.threadCount;
+  wordIndexCapacity = other.wordIndexCapacity;
+  engine = other.engine;
   return *this;
 }
 
-const Map<std::string, List<int>> & TextAnalyzer::getDictionary() const
+const TextAnalyzer::Dictionary & TextAnalyzer::getDictionary() const
 {
   return dictionary;
 }
 
+std::pair<TextAnalyzer::Dictionary::const_iterator, TextAnalyzer::Dictionary::const_iterator>
+TextAnalyzer::getPrefixRange(std::string_view prefix) const
+{
+  auto folded = std::string{ prefix };
+  for (auto & ch : folded) {
+    ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+  }
+  return dictionary.prefix_range(folded);
+}
+
+void TextAnalyzer::setThreadCount(unsigned count)
+{
+  threadCount = count;
+}
+
+unsigned TextAnalyzer::getThreadCount() const
+{
+  return threadCount;
+}
+
+void TextAnalyzer::setWordIndexCapacity(std::size_t capacity)
+{
+  wordIndexCapacity = capacity;
+}
+
+std::size_t TextAnalyzer::getWordIndexCapacity() const
+{
+  return wordIndexCapacity;
+}
+
+void TextAnalyzer::setEngine(Engine value)
+{
+  engine = value;
+}
+
+TextAnalyzer::Engine TextAnalyzer::getEngine() const
+{
+  return engine;
+}
+
 void TextAnalyzer::analyze(const std::string & filename)
 {
-  dictionary = Map<std::string, List<int>>{ };
-  auto is = std::ifstream{ filename };
-  if (!is) {
-    throw std::invalid_argument{ "Can't open file " + filename };
+  auto file = FileBuffer{ filename };
+
+  analyzeBuffer(file.data());
+}
+
+namespace
+{
+  // Collects the words of consecutive lines into a dictionary with the configured engine. Text of
+  // a word is copied into the arena only when the word is first seen. The ordered engine updates
+  // the dictionary line by line, the hash engine fills it on finish().
+  class DictionaryBuilder
+  {
+
+    public:
+
+      DictionaryBuilder(TextAnalyzer::Engine engine, std::size_t indexCapacity);
+
+      void addLine(TextAnalyzer::Dictionary & dictionary, StringArena & words, std::string_view line, int number);
+
+      void finish(TextAnalyzer::Dictionary & dictionary);
+
+    private:
+
+      using WordIndex = HashIndex<std::string_view, PostingList *>;
+
+      using Entry = std::pair<std::string_view, PostingList>;
+
+      void addToTree(TextAnalyzer::Dictionary & dictionary, StringArena & words, std::string_view word, int number);
+
+      void addToTable(StringArena & words, std::string_view word, int number);
+
+      TextAnalyzer::Engine engine_;
+
+      Tokenizer tokenizer_;
+
+      std::unique_ptr<WordIndex> index_;
+
+      std::vector<Entry> entries_;
+
+      HashIndex<std::string_view, std::size_t> positions_;
+
+  };
+
+  DictionaryBuilder::DictionaryBuilder(TextAnalyzer::Engine engine, std::size_t indexCapacity) :
+      engine_{ engine },
+      tokenizer_{ },
+      index_{ },
+      entries_{ },
+      positions_{ }
+  {
+    if ((engine_ == TextAnalyzer::ORDERED_MAP) && (indexCapacity != TextAnalyzer::NO_WORD_INDEX)) {
+      index_ = std::make_unique<WordIndex>(indexCapacity);
+    }
   }
 
-  analyze(is);
+  void DictionaryBuilder::addLine(TextAnalyzer::Dictionary & dictionary, StringArena & words,
+      std::string_view line, int number)
+  {
+    tokenizer_.reset(line);
+    if (engine_ == TextAnalyzer::HASH_THEN_SORT) {
+      for (auto word = std::string_view{ }; tokenizer_.next(word); ) {
+        addToTable(words, word, number);
+      }
+    } else {
+      for (auto word = std::string_view{ }; tokenizer_.next(word); ) {
+        addToTree(dictionary, words, word, number);
+      }
+    }
+  }
+
+  // Words found in the optional index skip the tree descent
+  void DictionaryBuilder::addToTree(TextAnalyzer::Dictionary & dictionary, StringArena & words,
+      std::string_view word, int number)
+  {
+    if (index_) {
+      auto postings = index_->find(word);
+      if (postings) {
+        (*postings)->push_back(number);
+        return;
+      }
+    }
+    auto result = dictionary.try_emplace(word);
+    if (result.second) {
+      // Rebinding the key to an equal string does not change its position in the tree
+      result.first.key() = words.intern(word);
+    }
+    result.first.value().push_back(number);
+    if (index_) {
+      index_->insert(result.first.key(), &result.first.value());
+    }
+  }
+
+  void DictionaryBuilder::addToTable(StringArena & words, std::string_view word, int number)
+  {
+    auto position = positions_.find(word);
+    if (position) {
+      entries_[*position].second.push_back(number);
+      return;
+    }
+    entries_.emplace_back(words.intern(word), PostingList{ });
+    entries_.back().second.push_back(number);
+    positions_.insert(entries_.back().first, entries_.size() - 1u);
+  }
 
-  is.close();
+  // Hash-then-sort words are ordered once by their leading bytes packed into a word,
+  // full keys are compared only to break ties, and the tree is linked in O(n)
+  void DictionaryBuilder::finish(TextAnalyzer::Dictionary & dictionary)
+  {
+    if (engine_ == TextAnalyzer::ORDERED_MAP) {
+      return;
+    }
+    auto order = std::vector<std::pair<std::uint64_t, std::size_t>>{ };
+    order.reserve(entries_.size());
+    for (std::size_t k = 0u; k < entries_.size(); ++k) {
+      order.emplace_back(map_details::make_key_prefix(entries_[k].first), k);
+    }
+    std::sort(order.begin(), order.end(), [this] (const auto & lhs, const auto & rhs) {
+      return (lhs.first != rhs.first) ? (lhs.first < rhs.first)
+          : (entries_[lhs.second].first < entries_[rhs.second].first);
+    });
+    auto sorted = std::vector<Entry>{ };
+    sorted.reserve(entries_.size());
+    for (const auto & item : order) {
+      sorted.push_back(std::move(entries_[item.second]));
+    }
+    entries_.clear();
+    positions_.clear();
+    dictionary.assign_sorted(std::make_move_iterator(sorted.begin()), std::make_move_iterator(sorted.end()));
+  }
 }
 
 void TextAnalyzer::analyze(std::istream & is)
 {
-  dictionary = Map<std::string, List<int>>{ };
+  stream.reset();
+  dictionary.clear();
+  words.clear();
 
-  auto word_regex = std::regex{ "[a-zA-Z0-9]+" };
+  auto builder = DictionaryBuilder{ engine, wordIndexCapacity };
   auto line = std::string{ };
 
-  for (int i = 1; is; ++i) {
+  for (int i = 1; is && !is.eof(); ++i) {
 
     std::getline(is, line, '\n');
 
-    auto words_begin = std::sregex_iterator{ line.begin(), line.end(), word_regex };
-    auto words_end = std::sregex_iterator{ };
+    builder.addLine(dictionary, words, line, i);
+  }
+
+  builder.finish(dictionary);
+
+}
+
+namespace
+{
+  // Calls handle(line, number) for every '\n' separated line, the same lines std::getline
+  // produces in the stream overloads including the empty one after a trailing newline
+  template <typename Handler>
+  void forEachLine(std::string_view text, Handler handle, int first = 1)
+  {
+    auto begin = text.data();
+    auto end = text.data() + text.size();
+    for (int i = first; ; ++i) {
+      auto newline = static_cast<const char *>(std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+      if (!newline) {
+        handle(std::string_view{ begin, static_cast<size_t>(end - begin) }, i);
+        return;
+      }
+      handle(std::string_view{ begin, static_cast<size_t>(newline - begin) }, i);
+      begin = newline + 1;
+    }
+  }
+}
+
+namespace
+{
+  void buildDictionary(TextAnalyzer::Dictionary & dictionary, StringArena & words, DictionaryBuilder builder,
+      std::string_view text, int first)
+  {
+    forEachLine(text, [&] (std::string_view line, int i) {
+      builder.addLine(dictionary, words, line, i);
+    }, first);
+    builder.finish(dictionary);
+  }
 
-    for (auto itr = words_begin; itr != words_end; ++itr) {
-      auto word = itr->str();
-      std::transform(word.begin(), word.end(), word.begin(),
-          [ ] (char c) { return std::tolower(c); });
+  // Smaller inputs are not worth splitting between threads
+  const size_t MIN_CHUNK_SIZE = 1u << 16u;
 
-      if (dictionary.contains(word)) {
-        dictionary[word].push_back(i);
-      } else {
-        dictionary.insert(word, { i });
+  // Splits text into at most count pieces, each ending right after a newline except the last one
+  std::vector<std::string_view> splitIntoChunks(std::string_view text, size_t count)
+  {
+    auto chunks = std::vector<std::string_view>{ };
+    auto begin = size_t{ 0u };
+    for (size_t k = 1u; (k < count) && (begin < text.size()); ++k) {
+      auto end = std::max(begin, text.size() / count * k);
+      end = text.find('\n', end);
+      if (end == std::string_view::npos) {
+        break;
       }
+      chunks.push_back(text.substr(begin, end + 1u - begin));
+      begin = end + 1u;
     }
+    chunks.push_back(text.substr(begin));
+    return chunks;
   }
 
+  template <typename Function>
+  auto runParallel(size_t count, Function function)
+  {
+    auto futures = std::vector<std::future<decltype(function(size_t{ }))>>{ };
+    for (size_t k = 0u; k < count; ++k) {
+      futures.push_back(std::async(std::launch::async, function, k));
+    }
+    auto results = std::vector<decltype(function(size_t{ }))>{ };
+    for (auto & future : futures) {
+      results.push_back(future.get());
+    }
+    return results;
+  }
+}
+
+void TextAnalyzer::analyzeBuffer(std::string_view text)
+{
+  stream.reset();
+  dictionary.clear();
+  words.clear();
+
+  auto threads = size_t{ threadCount ? threadCount : std::max(std::thread::hardware_concurrency(), 1u) };
+  threads = std::min(threads, text.size() / MIN_CHUNK_SIZE + 1u);
+  if (threads == 1u) {
+    buildDictionary(dictionary, words, DictionaryBuilder{ engine, wordIndexCapacity }, text, 1);
+    return;
+  }
+
+  auto chunks = splitIntoChunks(text, threads);
+  auto newlines = runParallel(chunks.size(), [&chunks] (size_t k) {
+    return std::count(chunks[k].begin(), chunks[k].end(), '\n');
+  });
+  auto firstLines = std::vector<int>{ 1 };
+  for (size_t k = 1u; k < chunks.size(); ++k) {
+    firstLines.push_back(firstLines.back() + static_cast<int>(newlines[k - 1u]));
+  }
+
+  // Memory kept from the previous run is dealt out to the workers and gathered again below
+  auto maps = dictionary.divide_memory(chunks.size());
+  auto arenas = words.divide(chunks.size());
+  auto partials = runParallel(chunks.size(), [this, &chunks, &firstLines, &maps, &arenas] (size_t k) {
+    auto partial = std::make_pair(std::move(maps[k]), std::move(arenas[k]));
+    buildDictionary(partial.first, partial.second, DictionaryBuilder{ engine, wordIndexCapacity },
+        chunks[k], firstLines[k]);
+    return partial;
+  });
+
+  auto dictionaries = std::vector<Dictionary>{ };
+  for (auto & partial : partials) {
+    words.splice(std::move(partial.second));
+    dictionaries.push_back(std::move(partial.first));
+  }
+
+  // Neighbouring chunks are merged pairwise in order, so appended line numbers stay ascending
+  while (dictionaries.size() > 1u) {
+    auto merged = runParallel(dictionaries.size() / 2u, [&dictionaries] (size_t k) {
+      auto & partial = dictionaries[2u * k];
+      partial.merge(std::move(dictionaries[2u * k + 1u]),
+          [ ] (PostingList & postings, PostingList && next) { postings.append(next); });
+      return std::move(partial);
+    });
+    if (dictionaries.size() % 2u) {
+      merged.push_back(std::move(dictionaries.back()));
+    }
+    dictionaries = std::move(merged);
+  }
+  dictionary = std::move(dictionaries.front());
+}
+
+struct TextAnalyzer::StreamState
+{
+  DictionaryBuilder builder;
+  std::string tail;
+  int line;
+};
+
+void TextAnalyzer::begin()
+{
+  stream.reset();
+  dictionary.clear();
+  words.clear();
+  stream = std::make_unique<StreamState>(StreamState{ DictionaryBuilder{ ORDERED_MAP, wordIndexCapacity }, { }, 1 });
+}
+
+void TextAnalyzer::feed(std::string_view buffer)
+{
+  if (!stream) {
+    throw std::invalid_argument{ "Analysis stream is not started" };
+  }
+  auto last = buffer.rfind('\n');
+  if (last == std::string_view::npos) {
+    stream->tail.append(buffer);
+    return;
+  }
+  auto complete = buffer.substr(0u, last);
+  if (!stream->tail.empty()) {
+    // The first line of buffer finishes the one left over from the previous feed
+    auto end = complete.find('\n');
+    stream->tail.append(complete.substr(0u, end));
+    stream->builder.addLine(dictionary, words, stream->tail, stream->line++);
+    stream->tail.clear();
+    if (end == std::string_view::npos) {
+      stream->tail.assign(buffer.substr(last + 1u));
+      return;
+    }
+    complete.remove_prefix(end + 1u);
+  }
+  forEachLine(complete, [this] (std::string_view line, int i) {
+    stream->builder.addLine(dictionary, words, line, i);
+    stream->line = i + 1;
+  }, stream->line);
+  stream->tail.assign(buffer.substr(last + 1u));
+}
+
+void TextAnalyzer::finish()
+{
+  if (!stream) {
+    throw std::invalid_argument{ "Analysis stream is not started" };
+  }
+  stream->builder.addLine(dictionary, words, stream->tail, stream->line);
+  stream->builder.finish(dictionary);
+  stream.reset();
 }
 
 void TextAnalyzer::enumerateLines(const std::string & inFilename, const std::string & outFileName)
@@ -79,20 +437,15 @@ void TextAnalyzer::enumerateLines(const std::string & inFilename, const std::str
         "Can't output enumerated text to the file with the same name " + inFilename };
   }
 
-  auto is = std::ifstream{ inFilename };
-  if (!is) {
-    throw std::invalid_argument{ "Can't open file " + inFilename };
-  }
+  auto file = FileBuffer{ inFilename };
 
   auto os = std::ofstream{ outFileName };
   if (!os) {
-    is.close();
     throw std::invalid_argument{ "Can't create output file " + outFileName };
   }
 
-  enumerateLines(is, os);
+  enumerateBuffer(file.data(), os);
 
-  is.close();
   os.close();
 }
 
@@ -100,12 +453,21 @@ void TextAnalyzer::enumerateLines(std::istream & is, std::ostream & os)
 {
   auto line = std::string{ };
 
-  for (int i = 1; is; ++i) {
+  for (int i = 1; is && !is.eof(); ++i) {
     std::getline(is, line, '\n');
     os << i << ") " << line << '\n';
   }
 }
 
+void TextAnalyzer::enumerateBuffer(std::string_view text, std::ostream & os)
+{
+  forEachLine(text, [&os] (std::string_view line, int i) {
+    os << i << ") ";
+    os.write(line.data(), static_cast<std::streamsize>(line.size()));
+    os << '\n';
+  });
+}
+
 void TextAnalyzer::printAnalysis(const std::string & filename)
 {
   auto os = std::ofstream{ filename };
@@ -127,17 +489,17 @@ void TextAnalyzer::printAnalysis(std::ostream & os)
 {
   auto word = std::string{ "Word" };
   auto colwidth = word.length();
-  for (auto itr = dictionary.begin(); itr != dictionary.end(); ++itr) {
-    colwidth = std::max(itr.key().length(), colwidth);
-  }
+  dictionary.for_each([&colwidth] (std::string_view key, const PostingList &) {
+    colwidth = std::max(key.length(), colwidth);
+  });
   const auto margin = size_t{ 2u };
   os << "Word" << generateSpaces(colwidth - word.length() + margin) << "Lines\n"; 
-  for (auto itr = dictionary.begin(); itr != dictionary.end(); ++itr) {
-    os << itr.key() << generateSpaces(colwidth - itr.key().length() + margin);
-    std::for_each(itr.value().begin(), itr.value().end(),
+  dictionary.for_each([&os, colwidth, margin] (std::string_view key, const PostingList & lines) {
+    os << key << generateSpaces(colwidth - key.length() + margin);
+    std::for_each(lines.begin(), lines.end(),
         [&os] (int e) { os << e << ' '; });
     os << '\n';
-  }
+  });
 }
 
 namespace
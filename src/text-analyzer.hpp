@@ -2,45 +2,109 @@
 #define CROSS_REFS_TEXT_ANALYZER
 
 #include <ios>
+#include <limits>
+#include <memory>
 #include <string>
+#include <utility>
+#include <cstddef>
+#include <string_view>
 
 #include "map.hpp"
-#include "list.hpp"
+#include "posting-list.hpp"
+#include "string-arena.hpp"
 
 class TextAnalyzer
 {
 
   public:
 
+    // Words are views into storage owned by the analyzer, valid until the next analysis
+    using Dictionary = Map<std::string_view, PostingList>;
+
     TextAnalyzer();
 
     TextAnalyzer(const TextAnalyzer & other) = delete;
 
     TextAnalyzer(TextAnalyzer && other) noexcept;
 
-    ~TextAnalyzer() = default;
+    ~TextAnalyzer();
 
     TextAnalyzer & operator=(const TextAnalyzer & other) = delete;
 
     TextAnalyzer & operator=(TextAnalyzer && other) noexcept;
 
-    const Map<std::string, List<int>> & getDictionary() const;
+    const Dictionary & getDictionary() const;
+
+    // Words starting with prefix, compared case-insensitively like the analysis, with their lines
+    std::pair<Dictionary::const_iterator, Dictionary::const_iterator> getPrefixRange(std::string_view prefix) const;
+
+    // Number of worker threads used to analyze files and buffers, 0 means one per hardware thread
+    void setThreadCount(unsigned count);
+
+    unsigned getThreadCount() const;
+
+    static constexpr std::size_t NO_WORD_INDEX = 0u;
+
+    static constexpr std::size_t UNBOUNDED_WORD_INDEX = std::numeric_limits<std::size_t>::max();
+
+    // Hash index of words kept in front of the dictionary while analyzing: NO_WORD_INDEX disables it,
+    // UNBOUNDED_WORD_INDEX indexes every word, other values keep at most that many frequent words
+    void setWordIndexCapacity(std::size_t capacity);
+
+    std::size_t getWordIndexCapacity() const;
+
+    // ORDERED_MAP keeps the dictionary ordered while scanning, HASH_THEN_SORT collects words
+    // in a hash table and sorts them once into the dictionary when the scan is over
+    enum Engine
+    {
+      ORDERED_MAP, HASH_THEN_SORT
+    };
+
+    void setEngine(Engine value);
+
+    Engine getEngine() const;
 
     void analyze(const std::string & filename);
 
     void analyze(std::istream & is);
 
+    void analyzeBuffer(std::string_view text);
+
+    // Incremental analysis of text arriving in pieces. begin() starts a new dictionary, feed() adds
+    // every line completed by buffer and keeps the unfinished tail for the next call, finish() adds
+    // the tail as the last line. Line numbers continue across feeds and the dictionary can be read
+    // between them. Streams always use the ordered map engine.
+    void begin();
+
+    void feed(std::string_view buffer);
+
+    void finish();
+
     static void enumerateLines(const std::string & inFilename, const std::string & outFileName);
 
     static void enumerateLines(std::istream & is, std::ostream & os);
 
+    static void enumerateBuffer(std::string_view text, std::ostream & os);
+
     void printAnalysis(const std::string & filename);
 
     void printAnalysis(std::ostream & os);
 
   private:
 
-    Map<std::string, List<int>> dictionary;
+    StringArena words;
+
+    Dictionary dictionary;
+
+    unsigned threadCount;
+
+    std::size_t wordIndexCapacity;
+
+    Engine engine;
+
+    struct StreamState;
+
+    std::unique_ptr<StreamState> stream;
 
 };
 
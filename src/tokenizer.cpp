@@ -0,0 +1,256 @@
+#include "tokenizer.hpp"
+
+#include <array>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define CROSS_REFS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace tokenizer_details
+{
+  struct kernels_t
+  {
+    std::size_t (* findWord)(const char * text, std::size_t length);
+    std::size_t (* findSeparator)(const char * text, std::size_t length);
+    void (* foldCopy)(char * dest, const char * text, std::size_t length);
+  };
+}
+
+namespace
+{
+  // Lower case form of every word character, zero for separators
+  constexpr std::array<char, 256> makeFoldTable()
+  {
+    auto table = std::array<char, 256>{ };
+    for (auto c = '0'; c <= '9'; ++c) {
+      table[static_cast<unsigned char>(c)] = c;
+    }
+    for (auto c = 'a'; c <= 'z'; ++c) {
+      table[static_cast<unsigned char>(c)] = c;
+      table[static_cast<unsigned char>(c - 'a' + 'A')] = c;
+    }
+    return table;
+  }
+
+  constexpr auto FOLD_TABLE = makeFoldTable();
+
+  char fold(char c)
+  {
+    return FOLD_TABLE[static_cast<unsigned char>(c)];
+  }
+
+  std::size_t findWordScalar(const char * text, std::size_t length)
+  {
+    auto i = std::size_t{ 0u };
+    while ((i < length) && !fold(text[i])) {
+      ++i;
+    }
+    return i;
+  }
+
+  std::size_t findSeparatorScalar(const char * text, std::size_t length)
+  {
+    auto i = std::size_t{ 0u };
+    while ((i < length) && fold(text[i])) {
+      ++i;
+    }
+    return i;
+  }
+
+  void foldCopyScalar(char * dest, const char * text, std::size_t length)
+  {
+    for (auto i = std::size_t{ 0u }; i < length; ++i) {
+      dest[i] = fold(text[i]);
+    }
+  }
+
+  constexpr auto SCALAR_KERNELS = tokenizer_details::kernels_t{
+      findWordScalar, findSeparatorScalar, foldCopyScalar };
+
+#ifdef CROSS_REFS_X86_SIMD
+
+  // Bytes >= 0x80 are negative as signed chars and fail both range checks
+  __m128i classifySse2(__m128i bytes)
+  {
+    auto digit = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1)),
+        _mm_cmplt_epi8(bytes, _mm_set1_epi8('9' + 1)));
+    auto lower = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+    auto alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+        _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    return _mm_or_si128(digit, alpha);
+  }
+
+  unsigned wordMaskSse2(const char * text)
+  {
+    auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text));
+    return static_cast<unsigned>(_mm_movemask_epi8(classifySse2(bytes)));
+  }
+
+  std::size_t findWordSse2(const char * text, std::size_t length)
+  {
+    auto i = std::size_t{ 0u };
+    for (; i + 16u <= length; i += 16u) {
+      auto mask = wordMaskSse2(text + i);
+      if (mask) {
+        return i + static_cast<std::size_t>(__builtin_ctz(mask));
+      }
+    }
+    return i + findWordScalar(text + i, length - i);
+  }
+
+  std::size_t findSeparatorSse2(const char * text, std::size_t length)
+  {
+    auto i = std::size_t{ 0u };
+    for (; i + 16u <= length; i += 16u) {
+      auto mask = ~wordMaskSse2(text + i) & 0xFFFFu;
+      if (mask) {
+        return i + static_cast<std::size_t>(__builtin_ctz(mask));
+      }
+    }
+    return i + findSeparatorScalar(text + i, length - i);
+  }
+
+  // Only called on word bytes, so setting bit 5 of letters is enough to fold them
+  void foldCopySse2(char * dest, const char * text, std::size_t length)
+  {
+    auto i = std::size_t{ 0u };
+    for (; i + 16u <= length; i += 16u) {
+      auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+      auto letter = _mm_cmpgt_epi8(bytes, _mm_set1_epi8('9'));
+      auto folded = _mm_or_si128(bytes, _mm_and_si128(letter, _mm_set1_epi8(0x20)));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i), folded);
+    }
+    foldCopyScalar(dest + i, text + i, length - i);
+  }
+
+  constexpr auto SSE2_KERNELS = tokenizer_details::kernels_t{
+      findWordSse2, findSeparatorSse2, foldCopySse2 };
+
+  __attribute__((target("avx2")))
+  unsigned wordMaskAvx2(const char * text)
+  {
+    auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text));
+    auto digit = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('0' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), bytes));
+    auto lower = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+    auto alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(digit, alpha)));
+  }
+
+  __attribute__((target("avx2")))
+  std::size_t findWordAvx2(const char * text, std::size_t length)
+  {
+    auto i = std::size_t{ 0u };
+    for (; i + 32u <= length; i += 32u) {
+      auto mask = wordMaskAvx2(text + i);
+      if (mask) {
+        return i + static_cast<std::size_t>(__builtin_ctz(mask));
+      }
+    }
+    return i + findWordSse2(text + i, length - i);
+  }
+
+  __attribute__((target("avx2")))
+  std::size_t findSeparatorAvx2(const char * text, std::size_t length)
+  {
+    auto i = std::size_t{ 0u };
+    for (; i + 32u <= length; i += 32u) {
+      auto mask = ~wordMaskAvx2(text + i);
+      if (mask) {
+        return i + static_cast<std::size_t>(__builtin_ctz(mask));
+      }
+    }
+    return i + findSeparatorSse2(text + i, length - i);
+  }
+
+  __attribute__((target("avx2")))
+  void foldCopyAvx2(char * dest, const char * text, std::size_t length)
+  {
+    auto i = std::size_t{ 0u };
+    for (; i + 32u <= length; i += 32u) {
+      auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i));
+      auto letter = _mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('9'));
+      auto folded = _mm256_or_si256(bytes, _mm256_and_si256(letter, _mm256_set1_epi8(0x20)));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i), folded);
+    }
+    foldCopySse2(dest + i, text + i, length - i);
+  }
+
+  constexpr auto AVX2_KERNELS = tokenizer_details::kernels_t{
+      findWordAvx2, findSeparatorAvx2, foldCopyAvx2 };
+
+#endif
+
+  const tokenizer_details::kernels_t * selectKernels(Tokenizer::Isa isa)
+  {
+    if (!Tokenizer::isSupported(isa)) {
+      throw std::invalid_argument{ "Instruction set is not supported by this CPU" };
+    }
+#ifdef CROSS_REFS_X86_SIMD
+    if (isa == Tokenizer::AUTO) {
+      isa = Tokenizer::isSupported(Tokenizer::AVX2) ? Tokenizer::AVX2 : Tokenizer::SSE2;
+    }
+    if (isa == Tokenizer::AVX2) {
+      return &AVX2_KERNELS;
+    }
+    if (isa == Tokenizer::SSE2) {
+      return &SSE2_KERNELS;
+    }
+#endif
+    return &SCALAR_KERNELS;
+  }
+}
+
+Tokenizer::Tokenizer(Isa isa) :
+    text_{ },
+    pos_{ 0u },
+    word_{ },
+    kernels_{ selectKernels(isa) }
+{ }
+
+Tokenizer::Tokenizer(std::string_view text, Isa isa) :
+    text_{ text },
+    pos_{ 0u },
+    word_{ },
+    kernels_{ selectKernels(isa) }
+{ }
+
+bool Tokenizer::isSupported(Isa isa)
+{
+  switch (isa) {
+    case AUTO:
+    case SCALAR:
+      return true;
+#ifdef CROSS_REFS_X86_SIMD
+    case SSE2:
+      return true;
+    case AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+void Tokenizer::reset(std::string_view text)
+{
+  text_ = text;
+  pos_ = 0u;
+}
+
+bool Tokenizer::next(std::string_view & word)
+{
+  pos_ += kernels_->findWord(text_.data() + pos_, text_.size() - pos_);
+  if (pos_ == text_.size()) {
+    return false;
+  }
+  auto length = kernels_->findSeparator(text_.data() + pos_, text_.size() - pos_);
+  word_.resize(length);
+  kernels_->foldCopy(&word_[0], text_.data() + pos_, length);
+  pos_ += length;
+  word = word_;
+  return true;
+}
@@ -0,0 +1,47 @@
+#ifndef CROSS_REFS_TOKENIZER
+#define CROSS_REFS_TOKENIZER
+
+#include <string>
+#include <cstddef>
+#include <string_view>
+
+namespace tokenizer_details
+{
+  struct kernels_t;
+}
+
+// Splits text into the words matched by /[a-zA-Z0-9]+/, folding them to lower case
+class Tokenizer
+{
+
+  public:
+
+    // Instruction set used to classify and fold bytes, AUTO picks the widest one the CPU supports
+    enum Isa
+    {
+      AUTO, SCALAR, SSE2, AVX2
+    };
+
+    explicit Tokenizer(Isa isa = AUTO);
+
+    explicit Tokenizer(std::string_view text, Isa isa = AUTO);
+
+    static bool isSupported(Isa isa);
+
+    void reset(std::string_view text);
+
+    bool next(std::string_view & word);
+
+  private:
+
+    std::string_view text_;
+
+    std::size_t pos_;
+
+    std::string word_;
+
+    const tokenizer_details::kernels_t * kernels_;
+
+};
+
+#endif
@@ -1,10 +1,50 @@
 #define BOOST_TEST_MODULE TEXT_ANALYZER
 #include <boost/test/included/unit_test.hpp>
 
+#include <cctype>
 #include <cstdio>
+#include <cstring>
+#include <regex>
+#include <limits>
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+#include <sstream>
+#include <iterator>
+#include <algorithm>
 #include <iostream>
 
 #include "../src/text-analyzer.hpp"
+#include "../src/map.hpp"
+#include "../src/indexed-map.hpp"
+#include "../src/list.hpp"
+#include "../src/posting-list.hpp"
+#include "../src/node-pool.hpp"
+#include "../src/hash-index.hpp"
+#include "../src/tokenizer.hpp"
+#include "../src/file-buffer.hpp"
+#include "../src/string-arena.hpp"
+
+template <typename Container>
+std::vector<int> toVector(const Container & container)
+{
+  auto values = std::vector<int>{ };
+  for (auto itr = container.begin(); itr != container.end(); ++itr) {
+    values.push_back(*itr);
+  }
+  return values;
+}
+
+template <typename MapType>
+std::vector<int> keysOf(const MapType & map)
+{
+  auto keys = std::vector<int>{ };
+  for (auto itr = map.begin(); itr != map.end(); ++itr) {
+    keys.push_back(itr.key());
+  }
+  return keys;
+}
 
 BOOST_AUTO_TEST_SUITE(CrossReference)
 
@@ -118,6 +158,192 @@ BOOST_AUTO_TEST_CASE(OtherSymbols_DontMatter)
   testFile(outFilename, expected, 1);
 }
 
+BOOST_AUTO_TEST_CASE(EnumeratedFile_MatchesStreamEnumeration)
+{
+  for (auto text : { "", "a", "a\n", "a\n\nb", "a\r\nb\n\n" }) {
+    {
+      auto out = std::ofstream{ inFilename, std::ios::binary };
+      out << text;
+    }
+    TextAnalyzer::enumerateLines(inFilename, outFilename);
+    auto in = std::ifstream{ outFilename };
+    auto actual = std::string{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{ } };
+    auto is = std::istringstream{ text };
+    auto expected = std::ostringstream{ };
+    TextAnalyzer::enumerateLines(is, expected);
+    BOOST_CHECK_EQUAL(actual, expected.str());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(UnmappableFile_IsReadIntoMemory)
+{
+  auto file = FileBuffer{ "/dev/null" };
+  BOOST_CHECK(!file.isMapped());
+  BOOST_CHECK(file.data().empty());
+  auto a = TextAnalyzer{};
+  BOOST_CHECK_NO_THROW(a.analyze("/dev/null"));
+}
+
+BOOST_AUTO_TEST_CASE(LastLineWithoutNewline_IsCountedOnce)
+{
+  auto is = std::istringstream{ "a\nb" };
+  auto os = std::ostringstream{ };
+  TextAnalyzer::enumerateLines(is, os);
+  BOOST_CHECK_EQUAL(os.str(), "1) a\n2) b\n");
+}
+
+std::string generateText(size_t lines, unsigned seed)
+{
+  auto engine = std::mt19937{ seed };
+  auto letter = std::uniform_int_distribution<int>{ 0, 5 };
+  auto length = std::uniform_int_distribution<int>{ 0, 12 };
+  auto text = std::string{ };
+  for (size_t i = 0u; i < lines; ++i) {
+    for (int words = length(engine); words > 0; --words) {
+      for (int chars = letter(engine) + 1; chars > 0; --chars) {
+        text += static_cast<char>("aBcDeF"[letter(engine)]);
+      }
+      text += ' ';
+    }
+    text += '\n';
+  }
+  return text;
+}
+
+BOOST_AUTO_TEST_CASE(ParallelAnalysis_MatchesSequentialAnalysis)
+{
+  auto text = generateText(40000u, 7u);
+  auto sequential = TextAnalyzer{ };
+  sequential.analyzeBuffer(text);
+  auto expected = std::ostringstream{ };
+  sequential.printAnalysis(expected);
+  for (auto threads : { 2u, 3u, 8u }) {
+    auto parallel = TextAnalyzer{ };
+    parallel.setThreadCount(threads);
+    parallel.analyzeBuffer(text);
+    auto actual = std::ostringstream{ };
+    parallel.printAnalysis(actual);
+    BOOST_CHECK(actual.str() == expected.str());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(RepeatedParallelAnalysis_ReusesMemory)
+{
+  auto text = generateText(40000u, 7u);
+  auto analyzer = TextAnalyzer{ };
+  analyzer.setThreadCount(4u);
+  auto expected = std::string{ };
+  auto nodes = std::set<const void *>{ };
+  auto settled = size_t{ 0u };
+  for (int run = 0; run < 5; ++run) {
+    analyzer.analyzeBuffer(text);
+    auto actual = std::ostringstream{ };
+    analyzer.printAnalysis(actual);
+    BOOST_CHECK(run == 0 || actual.str() == expected);
+    expected = actual.str();
+    const auto & dictionary = analyzer.getDictionary();
+    for (auto itr = dictionary.begin(); itr != dictionary.end(); ++itr) {
+      nodes.insert(&itr.key());
+    }
+    settled = (run == 1) ? nodes.size() : settled;
+  }
+  BOOST_CHECK_EQUAL(nodes.size(), settled);
+}
+
+BOOST_AUTO_TEST_CASE(WordIndex_DoesntChangeAnalysis)
+{
+  auto text = generateText(20000u, 5u);
+  auto plain = TextAnalyzer{ };
+  plain.analyzeBuffer(text);
+  auto expected = std::ostringstream{ };
+  plain.printAnalysis(expected);
+  for (auto capacity : { TextAnalyzer::UNBOUNDED_WORD_INDEX, size_t{ 1u }, size_t{ 100u } }) {
+    for (auto threads : { 1u, 4u }) {
+      auto indexed = TextAnalyzer{ };
+      indexed.setWordIndexCapacity(capacity);
+      indexed.setThreadCount(threads);
+      indexed.analyzeBuffer(text);
+      auto actual = std::ostringstream{ };
+      indexed.printAnalysis(actual);
+      BOOST_CHECK(actual.str() == expected.str());
+    }
+    auto streamed = TextAnalyzer{ };
+    streamed.setWordIndexCapacity(capacity);
+    auto is = std::istringstream{ text };
+    streamed.analyze(is);
+    auto actual = std::ostringstream{ };
+    streamed.printAnalysis(actual);
+    BOOST_CHECK(actual.str() == expected.str());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(HashThenSortEngine_MatchesOrderedMap)
+{
+  auto text = generateText(20000u, 9u);
+  auto ordered = TextAnalyzer{ };
+  ordered.analyzeBuffer(text);
+  auto expected = std::ostringstream{ };
+  ordered.printAnalysis(expected);
+  for (auto threads : { 1u, 3u }) {
+    auto hashed = TextAnalyzer{ };
+    hashed.setEngine(TextAnalyzer::HASH_THEN_SORT);
+    hashed.setThreadCount(threads);
+    hashed.analyzeBuffer(text);
+    BOOST_CHECK(hashed.getDictionary().is_valid());
+    auto actual = std::ostringstream{ };
+    hashed.printAnalysis(actual);
+    BOOST_CHECK(actual.str() == expected.str());
+  }
+  auto streamed = TextAnalyzer{ };
+  streamed.setEngine(TextAnalyzer::HASH_THEN_SORT);
+  auto is = std::istringstream{ "b a\nc b\n\nab" };
+  streamed.analyze(is);
+  BOOST_CHECK_EQUAL(toVector(streamed.getDictionary()["b"]).size(), 2u);
+  BOOST_CHECK_EQUAL(toVector(streamed.getDictionary()["ab"]).front(), 4);
+  BOOST_CHECK(streamed.getDictionary().begin().key() == "a");
+}
+
+BOOST_AUTO_TEST_CASE(StreamedPieces_MatchWholeBufferAnalysis)
+{
+  auto text = generateText(5000u, 3u);
+  text += "last line without newline";
+  auto whole = TextAnalyzer{ };
+  whole.analyzeBuffer(text);
+  auto expected = std::ostringstream{ };
+  whole.printAnalysis(expected);
+  auto engine = std::mt19937{ 3u };
+  for (auto maxPiece : { 1, 7, 100, 5000 }) {
+    auto piece = std::uniform_int_distribution<size_t>{ 0u, static_cast<size_t>(maxPiece) };
+    auto streamed = TextAnalyzer{ };
+    streamed.begin();
+    for (size_t pos = 0u; pos < text.size(); ) {
+      auto size = std::min(piece(engine), text.size() - pos);
+      streamed.feed(std::string_view{ text }.substr(pos, size));
+      pos += size;
+    }
+    streamed.finish();
+    auto actual = std::ostringstream{ };
+    streamed.printAnalysis(actual);
+    BOOST_CHECK(actual.str() == expected.str());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(StreamedDictionary_IsReadableBetweenFeeds)
+{
+  auto a = TextAnalyzer{ };
+  BOOST_CHECK_THROW(a.feed("word"), std::invalid_argument);
+  a.begin();
+  a.feed("alpha beta\nbe");
+  BOOST_CHECK_EQUAL(toVector(a.getDictionary()["beta"]).front(), 1);
+  BOOST_CHECK(!a.getDictionary().contains("be"));
+  a.feed("ta gamma\n\nalpha");
+  BOOST_CHECK((toVector(a.getDictionary()["beta"]) == std::vector<int>{ 1, 2 }));
+  BOOST_CHECK_EQUAL(toVector(a.getDictionary()["alpha"]).size(), 1u);
+  a.finish();
+  BOOST_CHECK((toVector(a.getDictionary()["alpha"]) == std::vector<int>{ 1, 4 }));
+  BOOST_CHECK_THROW(a.finish(), std::invalid_argument);
+}
+
 BOOST_AUTO_TEST_CASE(InvalidFileName_ThrowsInvalidArgument)
 {
   auto a = TextAnalyzer{};
@@ -125,3 +351,1075 @@ BOOST_AUTO_TEST_CASE(InvalidFileName_ThrowsInvalidArgument)
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(MapContainer)
+
+BOOST_AUTO_TEST_CASE(TryEmplace_InsertsOnlyMissingKeys)
+{
+  auto map = Map<std::string, int>{ };
+  auto first = map.try_emplace("word", 1);
+  BOOST_CHECK(first.second);
+  BOOST_CHECK_EQUAL(first.first.value(), 1);
+  auto second = map.try_emplace("word", 2);
+  BOOST_CHECK(!second.second);
+  BOOST_CHECK(first.first == second.first);
+  BOOST_CHECK_EQUAL(map["word"], 1);
+}
+
+BOOST_AUTO_TEST_CASE(MoveOnlyValues_AreMovedIntoNodes)
+{
+  auto map = Map<std::string, std::unique_ptr<int>>{ };
+  map.insert("one", std::make_unique<int>(1));
+  BOOST_CHECK(map.try_emplace("two", new int{ 2 }).second);
+  auto key = std::string(40u, 'k');
+  BOOST_CHECK(map.try_emplace(std::move(key), std::make_unique<int>(3)).second);
+  auto present = std::string{ "one" };
+  BOOST_CHECK(!map.try_emplace(std::move(present), std::make_unique<int>(4)).second);
+  BOOST_CHECK_EQUAL(present, "one");
+  map.insert("two", std::make_unique<int>(5));
+  BOOST_CHECK_EQUAL(*map["one"], 1);
+  BOOST_CHECK_EQUAL(*map["two"], 5);
+  BOOST_CHECK_EQUAL(*map[std::string(40u, 'k')], 3);
+  BOOST_CHECK(map.is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(TryEmplace_KeepsKeysOrdered)
+{
+  auto map = Map<int, int>{ };
+  for (int i = 0; i < 100; ++i) {
+    map.try_emplace((i * 37) % 100, i);
+  }
+  auto expected = 0;
+  for (auto itr = map.begin(); itr != map.end(); ++itr) {
+    BOOST_CHECK_EQUAL(itr.key(), expected++);
+  }
+  BOOST_CHECK_EQUAL(expected, 100);
+}
+
+BOOST_AUTO_TEST_CASE(Insert_KeepsRedBlackProperties)
+{
+  auto map = Map<int, int>{ };
+  BOOST_CHECK(map.is_valid());
+  for (int i = 0; i < 500; ++i) {
+    map.insert((i * 7919) % 1000, i);
+    BOOST_CHECK(map.is_valid());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(AssignSorted_BuildsValidTree)
+{
+  for (int count = 0; count < 70; ++count) {
+    auto items = std::vector<std::pair<int, int>>{ };
+    for (int i = 0; i < count; ++i) {
+      items.emplace_back(i * 2, -i);
+    }
+    auto map = Map<int, int>{ };
+    map.insert(1, 1);
+    map.assign_sorted(items.begin(), items.end());
+    BOOST_CHECK(map.is_valid());
+    BOOST_CHECK(!map.contains(1));
+    auto expected = 0;
+    for (auto itr = map.begin(); itr != map.end(); ++itr, expected += 2) {
+      BOOST_CHECK_EQUAL(itr.key(), expected);
+      BOOST_CHECK_EQUAL(itr.value(), -expected / 2);
+    }
+    BOOST_CHECK_EQUAL(expected, count * 2);
+    for (int i = 0; i < count; ++i) {
+      map.insert(i * 2 + 1, i);
+    }
+    BOOST_CHECK(map.is_valid());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(RepeatedAssignSorted_ReusesNodes)
+{
+  auto items = std::vector<std::pair<int, int>>{ };
+  for (int i = 0; i < 1000; ++i) {
+    items.emplace_back(i, -i);
+  }
+  auto map = Map<int, int>{ };
+  auto addresses = std::set<const int *>{ };
+  for (int round = 0; round < 50; ++round) {
+    map.assign_sorted(items.begin(), items.end());
+    for (auto itr = map.begin(); itr != map.end(); ++itr) {
+      addresses.insert(&itr.key());
+    }
+  }
+  BOOST_CHECK(map.is_valid());
+  BOOST_CHECK_EQUAL(map.size(), 1000u);
+  BOOST_CHECK_LE(addresses.size(), 2000u);
+}
+
+BOOST_AUTO_TEST_CASE(AssignSorted_RejectsUnsortedRange)
+{
+  auto items = std::vector<std::pair<std::string, int>>{ { "a", 1 }, { "c", 2 }, { "c", 3 } };
+  auto map = Map<std::string, int>{ };
+  map.insert("b", 0);
+  BOOST_CHECK_THROW(map.assign_sorted(items.begin(), items.end()), std::invalid_argument);
+  BOOST_CHECK(map.contains("b"));
+  map.assign_sorted(std::make_move_iterator(items.begin()), std::make_move_iterator(items.begin() + 2));
+  BOOST_CHECK(map.contains("c"));
+  BOOST_CHECK(!map.contains("b"));
+}
+
+BOOST_AUTO_TEST_CASE(Merge_CombinesValuesOfEqualKeys)
+{
+  auto evens = Map<int, std::string>{ };
+  auto threes = Map<int, std::string>{ };
+  for (int i = 0; i < 300; ++i) {
+    evens.insert(i * 2, "e");
+  }
+  for (int i = 0; i < 200; ++i) {
+    threes.insert(i * 3, "t");
+  }
+  evens.merge(std::move(threes), [ ] (std::string & value, std::string && other) { value += other; });
+  BOOST_CHECK(evens.is_valid());
+  BOOST_CHECK(threes.is_valid());
+  BOOST_CHECK(threes.begin() == threes.end());
+  auto count = 0;
+  for (auto itr = evens.begin(); itr != evens.end(); ++itr, ++count) {
+    auto expected = std::string{ itr.key() % 2 ? "" : "e" } + (itr.key() % 3 ? "" : "t");
+    BOOST_CHECK_EQUAL(itr.value(), expected);
+  }
+  BOOST_CHECK_EQUAL(count, 300 + 200 - 100);
+  evens.insert(1001, "x");
+  BOOST_CHECK(evens.is_valid());
+  threes.insert(3, "t");
+  BOOST_CHECK(threes.contains(3));
+}
+
+BOOST_AUTO_TEST_CASE(Merge_ThrowingMergeFunctionLeavesBothMapsValid)
+{
+  auto map = Map<int, std::string>{ };
+  auto other = Map<int, std::string>{ };
+  for (int i = 0; i < 50; ++i) {
+    map.insert(i * 2, "m");
+    other.insert(i * 3, "o");
+  }
+  auto calls = 0;
+  auto merge_values = [&calls] (std::string & value, std::string && extra) {
+    if (++calls == 5) {
+      throw std::runtime_error{ "Merge failed" };
+    }
+    value += extra;
+  };
+  BOOST_CHECK_THROW(map.merge(std::move(other), merge_values), std::runtime_error);
+  BOOST_CHECK(map.is_valid());
+  BOOST_CHECK(other.is_valid());
+  BOOST_CHECK_EQUAL(keysOf(map).size(), 50u);
+  BOOST_CHECK_EQUAL(keysOf(other).size(), 50u);
+  BOOST_CHECK(map.contains(18));
+  BOOST_CHECK(other.contains(18));
+  map.insert(1001, "x");
+  other.insert(1001, "y");
+  BOOST_CHECK(map.is_valid());
+  BOOST_CHECK(other.is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(KeyPrefixes_OrderLikeStringCompare)
+{
+  auto engine = std::mt19937{ 3u };
+  auto byte = std::uniform_int_distribution<int>{ 0, 255 };
+  auto keys = std::vector<std::string>{ "", std::string(1u, '\0'), std::string(9u, '\0'), "abcdefgh", "abcdefghi", "abcdefgha" };
+  for (int i = 0; i < 400; ++i) {
+    auto key = std::string{ i % 2 ? "commonprefix" : "" };
+    for (int length = byte(engine) % 11; length > 0; --length) {
+      key += static_cast<char>(byte(engine) % 3 ? "\0\x7f\x80\xff"[byte(engine) % 4] : byte(engine));
+    }
+    keys.push_back(key);
+  }
+  auto map = Map<std::string, int>{ };
+  for (size_t i = 0u; i < keys.size(); i += 2u) {
+    map.insert(keys[i], 0);
+  }
+  BOOST_CHECK(map.is_valid());
+  for (size_t i = 0u; i < keys.size(); ++i) {
+    auto inserted = false;
+    for (size_t j = 0u; j < keys.size(); j += 2u) {
+      inserted = inserted || (keys[j] == keys[i]);
+    }
+    BOOST_CHECK_EQUAL(map.contains(keys[i]), inserted);
+  }
+  auto prev = std::string{ };
+  auto first = true;
+  for (auto itr = map.begin(); itr != map.end(); ++itr, first = false) {
+    BOOST_CHECK(first || (prev.compare(itr.key()) < 0));
+    prev = itr.key();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(KeyPrefixes_AreKeptOnlyForLexicographicStringKeys)
+{
+  struct ByLength
+  {
+    bool operator()(const std::string & lhs, const std::string & rhs) const
+    {
+      return (lhs.size() != rhs.size()) ? (lhs.size() < rhs.size()) : (lhs < rhs);
+    }
+  };
+  BOOST_CHECK((map_details::key_prefix_t<std::string, std::less<std::string>>::enabled));
+  BOOST_CHECK((!map_details::key_prefix_t<std::string, ByLength>::enabled));
+  BOOST_CHECK((!map_details::key_prefix_t<const char *, std::less<const char *>>::enabled));
+  BOOST_CHECK((sizeof(map_details::node_t<std::string, int, ByLength>)
+      < sizeof(map_details::node_t<std::string, int, std::less<std::string>>)));
+
+  auto byLength = Map<std::string, int, ByLength>{ };
+  for (auto word : { "ccc", "a", "bb", "aaaa", "b" }) {
+    byLength.insert(word, 0);
+  }
+  auto keys = std::vector<std::string>{ };
+  byLength.for_each([&keys] (const std::string & key, int) { keys.push_back(key); });
+  BOOST_CHECK((keys == std::vector<std::string>{ "a", "b", "bb", "ccc", "aaaa" }));
+
+  auto pointers = Map<const char *, int>{ };
+  pointers.insert(nullptr, 1);
+  pointers.insert("literal", 2);
+  BOOST_CHECK(pointers.contains(nullptr));
+  BOOST_CHECK(pointers.is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(Lookup_UsesComparatorEquivalence)
+{
+  struct CaseInsensitiveLess
+  {
+    bool operator()(const std::string & lhs, const std::string & rhs) const
+    {
+      return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+          [ ] (char a, char b) { return std::tolower(a) < std::tolower(b); });
+    }
+  };
+  auto map = Map<std::string, int, CaseInsensitiveLess>{ };
+  map.insert("Word", 1);
+  BOOST_CHECK(map.contains("word"));
+  BOOST_CHECK(!map.try_emplace("WORD", 2).second);
+  BOOST_CHECK_EQUAL(map["wOrD"], 1);
+  BOOST_CHECK(!map.contains("words"));
+}
+
+BOOST_AUTO_TEST_CASE(Erase_KeepsRedBlackProperties)
+{
+  auto engine = std::mt19937{ 19u };
+  auto number = std::uniform_int_distribution<int>{ 0, 999 };
+  auto map = Map<int, int>{ };
+  auto expected = std::set<int>{ };
+  for (int i = 0; i < 4000; ++i) {
+    auto key = number(engine);
+    if (i % 3) {
+      map.insert(key, -key);
+      expected.insert(key);
+    } else {
+      BOOST_CHECK_EQUAL(map.erase(key), expected.erase(key));
+    }
+    BOOST_REQUIRE(map.is_valid());
+  }
+  auto kept = map.begin();
+  ++kept;
+  auto next = map.erase(map.begin());
+  expected.erase(expected.begin());
+  BOOST_CHECK(next == kept);
+  BOOST_CHECK((keysOf(map) == std::vector<int>(expected.begin(), expected.end())));
+  BOOST_CHECK(map.is_valid());
+  while (map.begin() != map.end()) {
+    map.erase(map.begin());
+    BOOST_REQUIRE(map.is_valid());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(RangeErase_SplitsAndJoinsTree)
+{
+  auto engine = std::mt19937{ 23u };
+  for (int round = 0; round < 200; ++round) {
+    auto size = std::uniform_int_distribution<int>{ 0, 300 }(engine);
+    auto map = Map<int, int>{ };
+    auto expected = std::vector<int>{ };
+    for (int i = 0; i < size; ++i) {
+      map.insert(i * 2, i);
+      expected.push_back(i * 2);
+    }
+    auto bounds = std::uniform_int_distribution<int>{ 0, size };
+    auto from = bounds(engine);
+    auto to = bounds(engine);
+    if (from > to) {
+      std::swap(from, to);
+    }
+    auto first = map.begin();
+    for (int i = 0; i < from; ++i) {
+      ++first;
+    }
+    auto last = first;
+    for (int i = from; i < to; ++i) {
+      ++last;
+    }
+    auto result = map.erase(first, last);
+    BOOST_CHECK(result == last);
+    expected.erase(expected.begin() + from, expected.begin() + to);
+    BOOST_REQUIRE(map.is_valid());
+    BOOST_CHECK((keysOf(map) == expected));
+    map.insert(1, 1);
+    BOOST_CHECK(map.is_valid());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(OrderStatistics_FollowInsertEraseAndMerge)
+{
+  auto engine = std::mt19937{ 29u };
+  auto number = std::uniform_int_distribution<int>{ 0, 2000 };
+  auto map = Map<int, int>{ };
+  auto expected = std::set<int>{ };
+  for (int i = 0; i < 3000; ++i) {
+    auto key = number(engine);
+    if (i % 4) {
+      map.insert(key, key);
+      expected.insert(key);
+    } else {
+      map.erase(key);
+      expected.erase(key);
+    }
+  }
+  auto other = Map<int, int>{ };
+  for (int key = 1; key < 4000; key += 7) {
+    other.insert(key, key);
+    expected.insert(key);
+  }
+  map.merge(std::move(other), [ ] (int &, int &&) { });
+  auto first = map.select(100u);
+  auto last = map.select(200u);
+  map.erase(first, last);
+  expected.erase(std::next(expected.begin(), 100), std::next(expected.begin(), 200));
+  BOOST_REQUIRE(map.is_valid());
+  BOOST_REQUIRE_EQUAL(map.size(), expected.size());
+
+  auto keys = std::vector<int>(expected.begin(), expected.end());
+  for (size_t i = 0u; i < keys.size(); i += 13u) {
+    BOOST_CHECK_EQUAL(map.select(i).key(), keys[i]);
+    BOOST_CHECK_EQUAL(map.rank(keys[i]), i);
+    BOOST_CHECK_EQUAL(map.rank(keys[i] + 1), i + 1u);
+  }
+  for (int lower = -10; lower < 4100; lower += 97) {
+    auto upper = lower + 250;
+    auto count = std::distance(expected.lower_bound(lower), expected.lower_bound(upper));
+    BOOST_CHECK_EQUAL(map.count_range(lower, upper), static_cast<size_t>(count));
+  }
+  BOOST_CHECK_EQUAL(map.count_range(10, 5), 0u);
+  BOOST_CHECK_THROW(map.select(map.size()), std::out_of_range);
+  BOOST_CHECK_EQUAL((Map<int, int>{ }.size()), 0u);
+  BOOST_CHECK_EQUAL(sizeof(map_details::node_t<int, int, std::less<int>>::size), sizeof(std::uint32_t));
+}
+
+BOOST_AUTO_TEST_CASE(Bounds_MatchOrderedSet)
+{
+  auto map = Map<int, int>{ };
+  auto expected = std::set<int>{ };
+  for (int i = 0; i < 500; ++i) {
+    map.insert((i * 7919) % 1000, i);
+    expected.insert((i * 7919) % 1000);
+  }
+  const auto & constMap = map;
+  for (int key = -5; key < 1005; ++key) {
+    auto lower = expected.lower_bound(key);
+    auto upper = expected.upper_bound(key);
+    BOOST_CHECK((lower == expected.end()) ? (map.lower_bound(key) == map.end()) : (map.lower_bound(key).key() == *lower));
+    BOOST_CHECK((upper == expected.end()) ? (map.upper_bound(key) == map.end()) : (map.upper_bound(key).key() == *upper));
+    auto range = constMap.equal_range(key);
+    auto count = 0;
+    for (; range.first != range.second; ++range.first) {
+      BOOST_CHECK_EQUAL(range.first.key(), key);
+      ++count;
+    }
+    BOOST_CHECK_EQUAL(count, static_cast<int>(expected.count(key)));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(PrefixRange_ListsKeysWithPrefix)
+{
+  auto map = Map<std::string, int>{ };
+  for (auto word : { "ne", "net", "netting", "network", "networks", "new", "nf", "a", "nes" }) {
+    map.insert(word, 0);
+  }
+  auto collect = [&map] (std::string_view prefix) {
+    auto words = std::vector<std::string>{ };
+    for (auto range = map.prefix_range(prefix); range.first != range.second; ++range.first) {
+      words.push_back(range.first.key());
+    }
+    return words;
+  };
+  BOOST_CHECK((collect("net") == std::vector<std::string>{ "net", "netting", "network", "networks" }));
+  BOOST_CHECK((collect("network") == std::vector<std::string>{ "network", "networks" }));
+  BOOST_CHECK((collect("ne") == std::vector<std::string>{ "ne", "nes", "net", "netting", "network", "networks", "new" }));
+  BOOST_CHECK(collect("networking").empty());
+  BOOST_CHECK(collect("z").empty());
+  BOOST_CHECK_EQUAL(collect("").size(), 9u);
+
+  auto a = TextAnalyzer{ };
+  auto is = std::istringstream{ "Net nets\nnew NETWORK\nnest" };
+  a.analyze(is);
+  auto words = std::vector<std::string>{ };
+  auto lines = std::vector<int>{ };
+  for (auto range = a.getPrefixRange("NET"); range.first != range.second; ++range.first) {
+    words.emplace_back(range.first.key());
+    auto postings = toVector(range.first.value());
+    lines.insert(lines.end(), postings.begin(), postings.end());
+  }
+  BOOST_CHECK((words == std::vector<std::string>{ "net", "nets", "network" }));
+  BOOST_CHECK((lines == std::vector<int>{ 1, 1, 2 }));
+}
+
+BOOST_AUTO_TEST_CASE(TransparentPointerKeys_AreOrderedByAddress)
+{
+  const char text[] = "zebra\0apple\0mango";
+  auto map = Map<const char *, int, std::less<>>{ };
+  for (auto word : { text, text + 6, text + 12 }) {
+    map.insert(word, 0);
+  }
+  BOOST_CHECK(map.is_valid());
+  BOOST_CHECK(map.contains(text + 6));
+  BOOST_CHECK_EQUAL(map.begin().key(), text);
+  BOOST_CHECK_EQUAL(map.rank(text + 12), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(ReverseIteration_MatchesForwardIteration)
+{
+  auto map = Map<int, int>{ };
+  BOOST_CHECK(map.begin() == map.end());
+  BOOST_CHECK(map.rbegin() == map.rend());
+  auto engine = std::mt19937{ 31u };
+  auto number = std::uniform_int_distribution<int>{ 0, 3000 };
+  for (int i = 0; i < 2000; ++i) {
+    map.insert(number(engine), i);
+    if (i % 5 == 0) {
+      map.erase(number(engine));
+    }
+  }
+  map.erase(map.begin());
+  map.erase(--map.end());
+  map.erase(map.select(map.size() - 10u), map.end());
+  map.erase(map.begin(), map.select(10u));
+  auto other = Map<int, int>{ };
+  other.insert(-1, 0);
+  other.insert(5000, 0);
+  map.merge(std::move(other), [ ] (int &, int &&) { });
+  BOOST_REQUIRE(map.is_valid());
+  BOOST_CHECK_EQUAL(map.begin().key(), -1);
+  BOOST_CHECK_EQUAL((--map.end()).key(), 5000);
+
+  auto forward = keysOf(map);
+  auto backward = std::vector<int>{ };
+  const auto & constMap = map;
+  for (auto itr = constMap.rbegin(); itr != constMap.rend(); ++itr) {
+    backward.push_back(itr.key());
+  }
+  BOOST_CHECK((backward == std::vector<int>(forward.rbegin(), forward.rend())));
+  auto decremented = std::vector<int>{ };
+  for (auto itr = map.end(); itr != map.begin(); ) {
+    decremented.push_back((--itr).key());
+  }
+  BOOST_CHECK(decremented == backward);
+  map.rbegin().value() = 42;
+  BOOST_CHECK_EQUAL(map[5000], 42);
+}
+
+BOOST_AUTO_TEST_CASE(Iterators_SurviveMovingTheMap)
+{
+  BOOST_CHECK_EQUAL(sizeof(Map<int, int>::iterator), sizeof(void *));
+  BOOST_CHECK_EQUAL(sizeof(Map<int, int>::const_reverse_iterator), sizeof(void *));
+  auto map = Map<int, int>{ };
+  for (int i = 0; i < 100; ++i) {
+    map.insert(i, -i);
+  }
+  auto first = map.begin();
+  auto last = map.end();
+  auto moved = std::move(map);
+  BOOST_CHECK(first == moved.begin());
+  BOOST_CHECK(last == moved.end());
+  BOOST_CHECK_EQUAL((--last).key(), 99);
+  BOOST_CHECK(++last == moved.end());
+
+  auto stale = moved.end();
+  moved.insert(100, -100);
+  BOOST_CHECK(stale == moved.end());
+  BOOST_CHECK_EQUAL((--moved.end()).key(), 100);
+  BOOST_CHECK_EQUAL((--Map<int, int>::iterator{ stale }).key(), 100);
+  BOOST_CHECK(moved.erase(moved.select(100u)) == moved.end());
+  BOOST_CHECK_EQUAL((--moved.end()).key(), 99);
+  BOOST_CHECK_EQUAL((--Map<int, int>::iterator{ stale }).key(), 99);
+
+  const auto reversed = moved.rbegin();
+  BOOST_CHECK_EQUAL(reversed.key(), 99);
+  BOOST_CHECK_EQUAL(reversed.value(), -99);
+  moved.erase(moved.find(50), moved.end());
+  BOOST_CHECK(moved.is_valid());
+  BOOST_CHECK(stale == moved.end());
+  BOOST_CHECK_EQUAL((--Map<int, int>::iterator{ stale }).key(), 49);
+
+  auto small = Map<int, int>{ };
+  auto emptyEnd = small.end();
+  small.insert(1, 1);
+  small.insert(2, 2);
+  auto keysEnd = small.end();
+  small.insert(3, 3);
+  BOOST_CHECK(keysEnd == small.end());
+  BOOST_CHECK_EQUAL((--keysEnd).key(), 3);
+  BOOST_CHECK_EQUAL((--emptyEnd).key(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(ForEach_VisitsElementsInOrder)
+{
+  auto map = Map<int, int>{ };
+  for (int i = 0; i < 5000; ++i) {
+    map.insert((i * 7919) % 5000, i);
+  }
+  auto visited = std::vector<int>{ };
+  map.for_each([&visited] (int key, int & value) {
+    visited.push_back(key);
+    value = -key;
+  });
+  BOOST_CHECK((visited == keysOf(map)));
+  const auto & constMap = map;
+  auto sum = 0L;
+  constMap.for_each([&sum] (int key, const int & value) { sum += key + value; });
+  BOOST_CHECK_EQUAL(sum, 0L);
+  Map<int, int>{ }.for_each([ ] (int, int &) { BOOST_ERROR("Empty map has no elements"); });
+}
+
+BOOST_AUTO_TEST_CASE(TransparentLookup_AcceptsKeyLikeValues)
+{
+  auto map = Map<std::string, int, std::less<>>{ };
+  for (int i = 0; i < 200; ++i) {
+    map.insert("key" + std::to_string(i), i);
+  }
+  auto view = std::string_view{ "key42 and more" }.substr(0u, 5u);
+  BOOST_CHECK(map.contains(view));
+  BOOST_CHECK(map.contains("key199"));
+  BOOST_CHECK(!map.contains(std::string_view{ "key" }));
+  BOOST_CHECK_EQUAL(map[view], 42);
+  map["key7"] = -7;
+  BOOST_CHECK_EQUAL(map.find(std::string_view{ "key7" }).value(), -7);
+  BOOST_CHECK(map.find("missing") == map.end());
+  BOOST_CHECK_THROW(map[std::string_view{ "missing" }], std::invalid_argument);
+
+  auto numbers = Map<long, int, std::less<>>{ };
+  for (int i = 0; i < 100; ++i) {
+    numbers.insert(i * 3L, i);
+  }
+  BOOST_CHECK(numbers.contains(99));
+  BOOST_CHECK(!numbers.contains(100));
+  BOOST_CHECK_EQUAL(numbers[short{ 30 }], 10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(ListContainer)
+
+BOOST_AUTO_TEST_CASE(AppendSorted_SkipsRepeatedLastValue)
+{
+  auto list = List<int>{ };
+  for (int value : { 1, 1, 2, 5, 5, 5, 9 }) {
+    list.append_sorted(value);
+  }
+  auto actual = toVector(list);
+  auto expected = std::vector<int>{ 1, 2, 5, 9 };
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+  BOOST_CHECK_THROW(list.append_sorted(3), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(PushBack_KeepsSetSemantics)
+{
+  auto list = List<int>{ 3, 1 };
+  list.push_back(1);
+  list.push_back(2);
+  list.push_back(3);
+  auto copy = list;
+  auto actual = toVector(copy);
+  auto expected = std::vector<int>{ 3, 1, 2 };
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(EmplaceBack_BuildsValuesInPlace)
+{
+  auto list = List<std::string>{ };
+  list.emplace_back(3u, 'a');
+  list.emplace_back("aaa");
+  list.push_back(std::string(40u, 'b'));
+  list.push_back(std::string(40u, 'b'));
+  auto actual = std::vector<std::string>{ };
+  for (const auto & value : list) {
+    actual.push_back(value);
+  }
+  auto expected = std::vector<std::string>{ "aaa", std::string(40u, 'b') };
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+
+  auto pointers = List<std::unique_ptr<int>>{ };
+  pointers.emplace_back(new int{ 7 });
+  pointers.push_back(std::make_unique<int>(8));
+  BOOST_CHECK_EQUAL(**pointers.begin(), 7);
+}
+
+BOOST_AUTO_TEST_CASE(SharedPool_ReusesNodesOfDestroyedLists)
+{
+  BOOST_CHECK_EQUAL(sizeof(List<int>), 3u * sizeof(void *));
+  auto pool = List<int>::pool_type{ };
+  auto first = List<int>{ pool };
+  auto second = List<int>{ pool };
+  for (int i = 0; i < 20; ++i) {
+    first.append_sorted(i);
+    second.push_back(-i);
+  }
+  auto copy = first;
+  copy.push_back(100);
+  auto freed = std::set<int *>{ };
+  for (auto & value : first) {
+    freed.insert(&value);
+  }
+  first = List<int>{ };
+  auto reused = List<int>{ pool };
+  reused.push_back(7);
+  BOOST_CHECK(freed.count(&*reused.begin()));
+  BOOST_CHECK(first.begin() == first.end());
+  BOOST_CHECK_EQUAL(toVector(second).size(), 20u);
+  BOOST_CHECK_EQUAL(toVector(copy).size(), 21u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(PostingListContainer)
+
+BOOST_AUTO_TEST_CASE(Values_RoundTripThroughEncoding)
+{
+  auto expected = std::vector<int>{ 1, 2, 127, 128, 129, 16384, 16385, 2000000000 };
+  auto postings = PostingList{ };
+  for (auto line : expected) {
+    postings.push_back(line);
+    postings.push_back(line);
+  }
+  BOOST_CHECK_EQUAL(postings.size(), expected.size());
+  BOOST_CHECK_EQUAL(postings.back(), 2000000000);
+  auto actual = toVector(postings);
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(Append_ConcatenatesAndSkipsSharedLine)
+{
+  auto head = PostingList{ };
+  auto tail = PostingList{ };
+  for (auto line : { 1, 300 }) {
+    head.push_back(line);
+  }
+  for (auto line : { 300, 301, 100000 }) {
+    tail.push_back(line);
+  }
+  head.append(tail);
+  head.append(PostingList{ });
+  auto actual = toVector(head);
+  auto expected = std::vector<int>{ 1, 300, 301, 100000 };
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+  BOOST_CHECK_EQUAL(head.size(), 4u);
+  BOOST_CHECK_EQUAL(head.back(), 100000);
+}
+
+BOOST_AUTO_TEST_CASE(OutOfOrderLine_ThrowsInvalidArgument)
+{
+  auto postings = PostingList{ };
+  BOOST_CHECK(postings.empty());
+  BOOST_CHECK(postings.begin() == postings.end());
+  postings.push_back(5);
+  BOOST_CHECK_THROW(postings.push_back(4), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(NodePoolAllocator)
+
+BOOST_AUTO_TEST_CASE(DestroyedNode_IsReused)
+{
+  auto pool = NodePool<std::string>{ };
+  auto first = pool.create("first");
+  auto second = pool.create("second");
+  BOOST_CHECK_EQUAL(*first, "first");
+  BOOST_CHECK_EQUAL(*second, "second");
+  pool.destroy(first);
+  auto third = pool.create("third");
+  BOOST_CHECK_EQUAL(third, first);
+  BOOST_CHECK_EQUAL(*third, "third");
+  pool.destroy(third);
+  pool.destroy(second);
+}
+
+BOOST_AUTO_TEST_CASE(PooledContainers_SurviveMoveAndReassignment)
+{
+  auto map = Map<std::string, List<std::string>>{ };
+  for (int i = 0; i < 1000; ++i) {
+    map.try_emplace(std::to_string(i)).first.value().push_back(std::to_string(-i));
+  }
+  auto moved = std::move(map);
+  map = Map<std::string, List<std::string>>{ };
+  map = std::move(moved);
+  auto copy = map["999"];
+  copy = map["42"];
+  BOOST_CHECK_EQUAL(*copy.begin(), "-42");
+  BOOST_CHECK(map.contains("500"));
+}
+
+BOOST_AUTO_TEST_CASE(SingleNodeFirstSlab_GrowsGeometrically)
+{
+  auto pool = NodePool<int, 1u>{ };
+  auto nodes = std::set<int *>{ };
+  for (int i = 0; i < 100; ++i) {
+    nodes.insert(pool.create(i));
+  }
+  BOOST_CHECK_EQUAL(nodes.size(), 100u);
+  auto sum = 0;
+  for (auto node : nodes) {
+    sum += *node;
+  }
+  BOOST_CHECK_EQUAL(sum, 4950);
+}
+
+BOOST_AUTO_TEST_CASE(ResetPool_CarvesSlabsFromStart)
+{
+  auto pool = NodePool<int>{ };
+  auto nodes = std::vector<int *>{ };
+  for (int i = 0; i < 100; ++i) {
+    nodes.push_back(pool.create(i));
+  }
+  pool.reset();
+  for (int i = 0; i < 100; ++i) {
+    BOOST_CHECK_EQUAL(pool.create(-i), nodes[i]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(DividedMemory_IsReusedAndGatheredByMerge)
+{
+  auto map = Map<int, int>{ };
+  auto addresses = std::set<const int *>{ };
+  for (int i = 0; i < 1000; ++i) {
+    addresses.insert(&map.try_emplace(i, i).first.key());
+  }
+  auto parts = map.divide_memory(3u);
+  BOOST_CHECK_EQUAL(parts.size(), 3u);
+  BOOST_CHECK_EQUAL(map.size(), 0u);
+  for (int i = 0; i < 300; ++i) {
+    BOOST_CHECK(addresses.count(&parts[0].try_emplace(i, i).first.key()));
+  }
+  for (size_t k = 1u; k < parts.size(); ++k) {
+    parts[0].merge(std::move(parts[k]), [ ] (int &, int &&) { });
+  }
+  for (int i = 300; i < 1000; ++i) {
+    BOOST_CHECK(addresses.count(&parts[0].try_emplace(i, i).first.key()));
+  }
+  BOOST_CHECK(parts[0].is_valid());
+  BOOST_CHECK_THROW(map.divide_memory(0u), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(ClearedMap_IsRefilledWithoutRecursion)
+{
+  auto map = Map<std::string, List<std::string>>{ };
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 100000; ++i) {
+      map.try_emplace(std::to_string(i * (round + 1))).first.value().push_back("x");
+    }
+    BOOST_REQUIRE(map.is_valid());
+    BOOST_CHECK_EQUAL(map.size(), 100000u);
+    map.clear();
+    BOOST_CHECK_EQUAL(map.size(), 0u);
+    BOOST_CHECK(map.begin() == map.end());
+  }
+  map.insert("last", { });
+  BOOST_CHECK(map.is_valid());
+  BOOST_CHECK(map.contains("last"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(HashIndexTable)
+
+BOOST_AUTO_TEST_CASE(UnboundedIndex_KeepsEveryKey)
+{
+  auto index = HashIndex<int, int>{ };
+  for (int i = 0; i < 10000; ++i) {
+    index.insert(i * 7, i);
+  }
+  BOOST_CHECK_EQUAL(index.size(), 10000u);
+  for (int i = 0; i < 10000; ++i) {
+    auto value = index.find(i * 7);
+    BOOST_REQUIRE(value);
+    BOOST_CHECK_EQUAL(*value, i);
+  }
+  BOOST_CHECK(!index.find(1));
+  index.insert(7, -1);
+  BOOST_CHECK_EQUAL(*index.find(7), -1);
+  index.clear();
+  BOOST_CHECK_EQUAL(index.size(), 0u);
+  BOOST_CHECK(!index.find(7));
+}
+
+BOOST_AUTO_TEST_CASE(BoundedIndex_KeepsHotKeys)
+{
+  auto index = HashIndex<std::string, int>{ 16u };
+  auto hot = std::vector<std::string>{ "the", "a", "of", "and" };
+  for (size_t i = 0u; i < hot.size(); ++i) {
+    index.insert(hot[i], static_cast<int>(i));
+  }
+  for (int i = 0; i < 5000; ++i) {
+    for (const auto & word : hot) {
+      BOOST_REQUIRE(index.find(word));
+    }
+    auto cold = "cold" + std::to_string(i);
+    if (!index.find(cold)) {
+      index.insert(cold, i);
+    }
+    BOOST_CHECK(index.size() <= 16u);
+  }
+  for (size_t i = 0u; i < hot.size(); ++i) {
+    BOOST_CHECK_EQUAL(*index.find(hot[i]), static_cast<int>(i));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(HugeBound_GrowsWithTheKeys)
+{
+  for (auto bound : { std::size_t{ 10000000u }, std::numeric_limits<std::size_t>::max() - 1u }) {
+    auto index = HashIndex<int, int>{ bound };
+    BOOST_CHECK_EQUAL(index.bound(), bound);
+    for (int i = 0; i < 1000; ++i) {
+      index.insert(i, -i);
+    }
+    BOOST_CHECK(index.size() <= 1000u);
+    BOOST_CHECK(index.size() > 900u);
+    auto found = 0;
+    for (int i = 0; i < 1000; ++i) {
+      auto value = index.find(i);
+      if (value) {
+        BOOST_CHECK_EQUAL(*value, -i);
+        ++found;
+      }
+    }
+    BOOST_CHECK_EQUAL(static_cast<std::size_t>(found), index.size());
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(WordTokenizer)
+
+std::vector<std::string> tokenize(const std::string & text, Tokenizer::Isa isa = Tokenizer::AUTO)
+{
+  auto words = std::vector<std::string>{ };
+  auto tokenizer = Tokenizer{ text, isa };
+  for (auto word = std::string_view{ }; tokenizer.next(word); ) {
+    words.emplace_back(word);
+  }
+  return words;
+}
+
+BOOST_AUTO_TEST_CASE(Words_AreFoldedToLowerCase)
+{
+  auto actual = tokenize("  Hello,WORLD-42 x9?");
+  auto expected = std::vector<std::string>{ "hello", "world", "42", "x9" };
+  BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(LongRuns_AreScannedWithEveryInstructionSet)
+{
+  auto text = std::string(70u, '-') + std::string(45u, 'Q') + std::string(33u, '\xE9') + "Zz9";
+  auto expected = std::vector<std::string>{ std::string(45u, 'q'), "zz9" };
+  for (auto isa : { Tokenizer::SCALAR, Tokenizer::SSE2, Tokenizer::AVX2 }) {
+    if (Tokenizer::isSupported(isa)) {
+      auto actual = tokenize(text, isa);
+      BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(Words_MatchRegexTokenization)
+{
+  auto regex = std::regex{ "[a-zA-Z0-9]+" };
+  auto engine = std::mt19937{ 42u };
+  auto byte = std::uniform_int_distribution<int>{ 0, 255 };
+  for (int round = 0; round < 200; ++round) {
+    auto text = std::string(static_cast<size_t>(byte(engine) * (round % 4 + 1)), ' ');
+    for (auto & c : text) {
+      auto b = byte(engine);
+      c = static_cast<char>(b % 8 ? "09azAZ_.[`@/:{ "[b % 15] + (b % 15 < 6 ? b % 3 : 0) : b);
+    }
+    auto expected = std::vector<std::string>{ };
+    for (auto itr = std::sregex_iterator{ text.begin(), text.end(), regex }; itr != std::sregex_iterator{ }; ++itr) {
+      auto word = itr->str();
+      std::transform(word.begin(), word.end(), word.begin(), [ ] (char c) { return std::tolower(c); });
+      expected.push_back(word);
+    }
+    for (auto isa : { Tokenizer::SCALAR, Tokenizer::SSE2, Tokenizer::AVX2 }) {
+      if (Tokenizer::isSupported(isa)) {
+        auto actual = tokenize(text, isa);
+        BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(IndexedMapContainer)
+
+BOOST_AUTO_TEST_CASE(Insert_MatchesPointerMap)
+{
+  auto engine = std::mt19937{ 11u };
+  auto number = std::uniform_int_distribution<int>{ 0, 5000 };
+  auto map = Map<int, int>{ };
+  auto indexed = IndexedMap<int, int>{ };
+  for (int i = 0; i < 3000; ++i) {
+    auto key = number(engine);
+    map.insert(key, i);
+    indexed.insert(key, i);
+  }
+  BOOST_CHECK(indexed.is_valid());
+  auto itr = map.begin();
+  auto count = size_t{ 0u };
+  for (auto indexedItr = indexed.begin(); indexedItr != indexed.end(); ++indexedItr, ++itr, ++count) {
+    BOOST_CHECK_EQUAL(indexedItr.key(), itr.key());
+    BOOST_CHECK_EQUAL(indexedItr.value(), itr.value());
+  }
+  BOOST_CHECK(itr == map.end());
+  BOOST_CHECK_EQUAL(count, indexed.size());
+  BOOST_CHECK(!indexed.try_emplace(indexed.begin().key()).second);
+  BOOST_CHECK_THROW(indexed[-1], std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(CopiedTree_IsIndependent)
+{
+  auto indexed = IndexedMap<std::string, int>{ };
+  for (int i = 0; i < 100; ++i) {
+    indexed.insert(std::to_string(i), i);
+  }
+  auto copy = indexed;
+  copy["42"] = -42;
+  copy.insert("x", 0);
+  BOOST_CHECK(copy.is_valid());
+  BOOST_CHECK_EQUAL(indexed["42"], 42);
+  BOOST_CHECK_EQUAL(copy["42"], -42);
+  BOOST_CHECK(!indexed.contains("x"));
+  BOOST_CHECK_EQUAL(copy.size(), 101u);
+}
+
+BOOST_AUTO_TEST_CASE(NodeArray_RoundTripsThroughMemcpy)
+{
+  auto indexed = IndexedMap<int, int>{ };
+  for (int i = 0; i < 500; ++i) {
+    indexed.insert((i * 37) % 500, i);
+  }
+  using node_type = IndexedMap<int, int>::node_type;
+  auto saved = std::vector<unsigned char>(indexed.size() * sizeof(node_type));
+  std::memcpy(saved.data(), indexed.data(), saved.size());
+  auto nodes = std::vector<node_type>(saved.size() / sizeof(node_type));
+  std::memcpy(nodes.data(), saved.data(), saved.size());
+  auto restored = IndexedMap<int, int>{ nodes.data(), nodes.size() };
+  BOOST_CHECK(restored.is_valid());
+  BOOST_CHECK_EQUAL(restored.size(), 500u);
+  auto itr = indexed.begin();
+  for (auto restoredItr = restored.begin(); restoredItr != restored.end(); ++restoredItr, ++itr) {
+    BOOST_CHECK_EQUAL(restoredItr.key(), itr.key());
+    BOOST_CHECK_EQUAL(restoredItr.value(), itr.value());
+  }
+  restored.insert(1000, 0);
+  BOOST_CHECK(restored.is_valid());
+  BOOST_CHECK_EQUAL((IndexedMap<int, int>{ nodes.data(), 0u }.size()), 0u);
+  BOOST_CHECK_THROW((IndexedMap<int, int>{ nodes.data(), nodes.size() - 1u }), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(NodeArray_RejectsBrokenTrees)
+{
+  using node_type = IndexedMap<int, int>::node_type;
+  const auto nil = indexed_map_details::NIL;
+  const auto black = indexed_map_details::COLOR_BIT;
+  auto cyclic = std::vector<node_type>{ { nil, nil, nil | black, 1, 0 }, { nil, nil, 2u | black, 2, 0 },
+      { nil, nil, 1u | black, 3, 0 } };
+  BOOST_CHECK_THROW((IndexedMap<int, int>{ cyclic.data(), cyclic.size() }), std::invalid_argument);
+  auto selfLinked = std::vector<node_type>{ { 0u, nil, nil | black, 1, 0 } };
+  BOOST_CHECK_THROW((IndexedMap<int, int>{ selfLinked.data(), selfLinked.size() }), std::invalid_argument);
+  auto unreachable = std::vector<node_type>{ { nil, nil, nil | black, 2, 0 }, { nil, nil, 0u, 1, 0 } };
+  BOOST_CHECK_THROW((IndexedMap<int, int>{ unreachable.data(), unreachable.size() }), std::invalid_argument);
+  auto sharedChild = std::vector<node_type>{ { 1u, 1u, nil | black, 2, 0 }, { nil, nil, 0u, 1, 0 } };
+  BOOST_CHECK_THROW((IndexedMap<int, int>{ sharedChild.data(), sharedChild.size() }), std::invalid_argument);
+  unreachable[0].left = 1u;
+  auto restored = IndexedMap<int, int>{ unreachable.data(), unreachable.size() };
+  BOOST_CHECK(restored.is_valid());
+  BOOST_CHECK(restored.contains(1));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(StringArenaStorage)
+
+BOOST_AUTO_TEST_CASE(InternedViews_SurviveGrowthAndSplice)
+{
+  auto arena = StringArena{ };
+  auto views = std::vector<std::string_view>{ };
+  auto expected = std::vector<std::string>{ };
+  for (int i = 0; i < 20000; ++i) {
+    expected.push_back("word" + std::to_string(i));
+    views.push_back(arena.intern(expected.back()));
+  }
+  auto large = std::string(100000u, 'x');
+  views.push_back(arena.intern(large));
+  expected.push_back(large);
+
+  auto other = StringArena{ };
+  views.push_back(other.intern("spliced"));
+  expected.push_back("spliced");
+  arena.splice(std::move(other));
+
+  auto moved = std::move(arena);
+  views.push_back(moved.intern("after"));
+  expected.push_back("after");
+  for (size_t i = 0; i < views.size(); ++i) {
+    BOOST_CHECK_EQUAL(views[i], expected[i]);
+  }
+  BOOST_CHECK(moved.intern("").empty());
+}
+
+BOOST_AUTO_TEST_CASE(DividedArena_KeepsChunks)
+{
+  auto arena = StringArena{ };
+  auto first = arena.intern("first");
+  for (int i = 0; i < 100000; ++i) {
+    arena.intern(std::to_string(i));
+  }
+  auto parts = arena.divide(4u);
+  BOOST_CHECK_EQUAL(parts.size(), 4u);
+  BOOST_CHECK_EQUAL(static_cast<const void *>(parts[0].intern("again").data()), static_cast<const void *>(first.data()));
+  for (auto & part : parts) {
+    arena.splice(std::move(part));
+  }
+  BOOST_CHECK_EQUAL(arena.intern("last"), "last");
+}
+
+BOOST_AUTO_TEST_CASE(ClearedArena_ReusesChunks)
+{
+  auto arena = StringArena{ };
+  auto first = arena.intern("first");
+  for (int i = 0; i < 20000; ++i) {
+    arena.intern(std::to_string(i));
+  }
+  arena.intern(std::string(100000u, 'x'));
+  arena.clear();
+  BOOST_CHECK_EQUAL(static_cast<const void *>(arena.intern("again").data()), static_cast<const void *>(first.data()));
+  for (int i = 0; i < 20000; ++i) {
+    BOOST_CHECK_EQUAL(arena.intern(std::to_string(i)), std::to_string(i));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(DictionaryWords_AreInternedOnce)
+{
+  auto analyzer = TextAnalyzer{ };
+  auto stream = std::istringstream{ "one two\ntwo one\nthree" };
+  analyzer.analyze(stream);
+  auto moved = std::move(analyzer);
+  const auto & dictionary = moved.getDictionary();
+  BOOST_CHECK_EQUAL(toVector(dictionary["two"]).size(), 2u);
+  BOOST_CHECK_EQUAL(toVector(dictionary["three"]).front(), 3);
+  auto words = std::vector<std::string>{ };
+  for (auto itr = moved.getDictionary().begin(); itr != moved.getDictionary().end(); ++itr) {
+    words.emplace_back(itr.key());
+  }
+  BOOST_CHECK((words == std::vector<std::string>{ "one", "three", "two" }));
+}
+
+BOOST_AUTO_TEST_SUITE_END()